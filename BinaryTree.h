@@ -3,8 +3,30 @@
 #ifndef BINARY_TREE
 #define BINARY_TREE
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <span>
 #include <stack>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "MemoryStats.h"
+#include "NodeArena.h"
+#include "Prefetch.h"
+#include "ShapeStats.h"
+#include "ThreadPool.h"
+#include "TreeFile.h"
+#include "TreeWalk.h"
 
 template <class T>
 struct BinaryNode
@@ -21,40 +43,157 @@ struct BinaryNode
 template <class T>
 class BinaryTree
 {
-private:
+public:
 	using node_ptr = BinaryNode<T>*;
+
+	// Number of descents search_batch advances in lock-step.
+	static constexpr std::size_t SEARCH_BATCH_WIDTH = 16;
+
+	// Subranges at most this long are built serially by buildFromSortedParallel.
+	static constexpr std::size_t PARALLEL_BUILD_GRAIN = 1 << 14;
+
+	// Subtrees expected to hold about this many nodes are measured serially
+	// by shape_stats.
+	static constexpr std::size_t PARALLEL_SHAPE_GRAIN = 1 << 14;
+
+	enum class RebuildMode { Off, Inline, Deferred, Incremental };
+
+	// An insert that lands more than factor * log2(size) links below the
+	// root triggers a rebuild. Inline rebuilds, before insert returns, the
+	// lowest enclosing subtree in which the new node is that deep relative
+	// to the subtree's own size (as a scapegoat tree does). Deferred only
+	// flags the tree, and the next maintain() rebalances it as a whole.
+	// Incremental starts beginRebalance(), and every later insert advances
+	// it by stepsPerInsert moves.
+	struct RebuildPolicy
+	{
+		RebuildMode mode = RebuildMode::Off;
+		double factor = 2.0;
+		std::size_t stepsPerInsert = 64;
+	};
+
+private:
 	node_ptr root = nullptr;
 	int size_ = 0;
+	NodeArena<BinaryNode<T>> arena;
+	RebuildPolicy policy;
+	bool rebuildPending_ = false;
+	std::size_t rebuilds = 0;
+	std::size_t rebuiltNodes_ = 0;
+
+	// Frame of the balanced build run by an incremental rebalance: a
+	// subtree of count keys whose left half (stage 1) or right half
+	// (stage 2) is being built above it on the stack.
+	struct BuildFrame
+	{
+		std::ptrdiff_t count;
+		node_ptr node = nullptr;
+		int stage = 0;
+	};
+
+	// A balanced copy of the tree, built a few nodes at a time in its own
+	// arena while the original keeps serving every call. Nodes inserted
+	// meanwhile are skipped by the copy and replayed into it afterwards.
+	struct IncrementalBuild
+	{
+		NodeArena<BinaryNode<T>> nodes;
+		std::vector<BuildFrame> frames;
+		node_ptr built = nullptr;
+		node_ptr cursor = nullptr;
+		std::unordered_set<node_ptr> fresh;
+		std::vector<T> log;
+		std::size_t replayed = 0;
+	};
+
+	std::unique_ptr<IncrementalBuild> incremental;
+
+	// The tree an incremental rebalance replaced. Its values are destroyed
+	// in postorder, a budget at a time, before its arena goes.
+	struct Teardown
+	{
+		NodeArena<BinaryNode<T>> nodes;
+		node_ptr top;
+		node_ptr next;
+	};
+
+	std::unique_ptr<Teardown> teardown;
 
 	template <class U>
-	void insert_left(node_ptr node, node_ptr parent, U&& x)
+	void insert_left(node_ptr node, node_ptr parent, U&& x, int depth)
 	{
 		if (node == nullptr)
 		{
-			node = new BinaryNode<T>(std::forward<U>(x));
+			node = arena.create(std::forward<U>(x));
 			parent->left = node;
 			node->parent = parent;
+			this->afterInsert_(node, depth);
 			return;
 		}
 		if (x >= node->value)
-			this->insert_right(node->right, node, std::forward<U>(x));
+			this->insert_right(node->right, node, std::forward<U>(x), depth + 1);
 		else if (x < node->value)
-			this->insert_left(node->left, node, std::forward<U>(x));
+			this->insert_left(node->left, node, std::forward<U>(x), depth + 1);
 	}
 	template <class U>
-	void insert_right(node_ptr node, node_ptr parent, U&& x)
+	void insert_right(node_ptr node, node_ptr parent, U&& x, int depth)
 	{
 		if (node == nullptr)
 		{
-			node = new BinaryNode<T>(std::forward<U>(x));
+			node = arena.create(std::forward<U>(x));
 			parent->right = node;
 			node->parent = parent;
+			this->afterInsert_(node, depth);
 			return;
 		}
 		if (x >= node->value)
-			this->insert_right(node->right, node, std::forward<U>(x));
+			this->insert_right(node->right, node, std::forward<U>(x), depth + 1);
 		else if (x < node->value)
-			this->insert_left(node->left, node, std::forward<U>(x));
+			this->insert_left(node->left, node, std::forward<U>(x), depth + 1);
+	}
+
+	bool tooDeep_(int depth, std::size_t size) const
+	{
+		return depth > policy.factor * std::log2(double(size));
+	}
+
+	// depth counts links from the root to the node just inserted.
+	void afterInsert_(node_ptr node, int depth)
+	{
+		if (incremental)
+		{
+			incremental->fresh.insert(node);
+			incremental->log.push_back(node->value);
+			return;
+		}
+		if (policy.mode == RebuildMode::Off || !this->tooDeep_(depth, std::size_t(size_)))
+			return;
+		if (policy.mode == RebuildMode::Deferred)
+		{
+			rebuildPending_ = true;
+			return;
+		}
+		if (policy.mode == RebuildMode::Incremental)
+		{
+			this->beginRebalance();
+			return;
+		}
+		// The root itself satisfies the test, so the walk always ends in a
+		// rebuild; the subtree sizes it counts are paid for by the rebuild.
+		std::size_t size = 1;
+		int height = 0;
+		for (node_ptr child = node, top = node->parent; top != nullptr; child = top, top = top->parent)
+		{
+			node_ptr sibling = child == top->left ? top->right : top->left;
+			walkPreorder(sibling, [&](node_ptr) { ++size; });
+			++size;
+			++height;
+			if (this->tooDeep_(height, size))
+			{
+				node_ptr parent = top->parent;
+				this->rebuild_(parent == nullptr ? root : parent->left == top ? parent->left : parent->right, parent);
+				return;
+			}
+		}
 	}
 
 	node_ptr searchRecursive_(node_ptr node, const T& x)
@@ -113,51 +252,283 @@ private:
 			return maximumNodeDepth_(node->right) + 1;
 	}
 
-	void inorder_(node_ptr node)
+	// Nodes live in the arena, so only the values need destroying before the
+	// chunks go back in one piece.
+	void clear_()
 	{
-		if (node != nullptr)
+		this->cancelIncremental_();
+		if (teardown)
+			this->teardownStep_(std::size_t(-1));
+		this->destroyValues_(root);
+		arena.releaseAll();
+		root = nullptr;
+		size_ = 0;
+		rebuildPending_ = false;
+	}
+
+	// Preorder with an explicit stack of pending right subtrees: it holds at
+	// most one entry per level and, unlike a parent-link walk, never
+	// revisits a node on the way up.
+	static void measureShape_(node_ptr top, ShapeStats& stats)
+	{
+		std::vector<std::pair<node_ptr, int>> pending;
+		node_ptr node = top;
+		int level = 0;
+		while (node != nullptr)
 		{
-			this->inorder_(node->left);
-			std::cout << node->value << " ";
-			this->inorder_(node->right);
+			stats.addNode(level, node->left == nullptr && node->right == nullptr);
+			if (node->left)
+			{
+				if (node->right)
+					pending.emplace_back(node->right, level + 1);
+				node = node->left;
+				++level;
+			}
+			else if (node->right)
+			{
+				node = node->right;
+				++level;
+			}
+			else if (pending.empty())
+				node = nullptr;
+			else
+			{
+				std::tie(node, level) = pending.back();
+				pending.pop_back();
+			}
 		}
 	}
 
-	void preorder_(node_ptr node)
+	// Day-Stout-Warren, phase one: right rotations turn the subtree hanging
+	// from head (a link of parent, or root) into a vine of right links in
+	// key order. Returns the node count.
+	std::size_t treeToVine_(node_ptr& head, node_ptr parent)
 	{
-		if (node != nullptr)
+		std::size_t count = 0;
+		node_ptr tail = nullptr;
+		node_ptr rest = head;
+		while (rest != nullptr)
 		{
-			std::cout << node->value << " ";
-			this->preorder_(node->left);
-			this->preorder_(node->right);
+			if (rest->left == nullptr)
+			{
+				tail = rest;
+				rest = rest->right;
+				++count;
+				continue;
+			}
+			node_ptr left = rest->left;
+			rest->left = left->right;
+			if (left->right)
+				left->right->parent = rest;
+			left->right = rest;
+			rest->parent = left;
+			if (tail == nullptr)
+			{
+				head = left;
+				left->parent = parent;
+			}
+			else
+			{
+				tail->right = left;
+				left->parent = tail;
+			}
+			rest = left;
+		}
+		return count;
+	}
+
+	// Phase two step: count left rotations down the vine, each lifting every
+	// second node above the one before it.
+	void compress_(node_ptr& head, node_ptr parent, std::size_t count)
+	{
+		node_ptr scanner = nullptr;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			node_ptr child = scanner == nullptr ? head : scanner->right;
+			node_ptr grandchild = child->right;
+			child->right = grandchild->left;
+			if (grandchild->left)
+				grandchild->left->parent = child;
+			grandchild->left = child;
+			child->parent = grandchild;
+			grandchild->parent = scanner == nullptr ? parent : scanner;
+			if (scanner == nullptr)
+				head = grandchild;
+			else
+				scanner->right = grandchild;
+			scanner = grandchild;
+		}
+	}
+
+	void rebuild_(node_ptr& head, node_ptr parent)
+	{
+		std::size_t count = this->treeToVine_(head, parent);
+		std::size_t full = (std::size_t(1) << (std::bit_width(count + 1) - 1)) - 1;
+		this->compress_(head, parent, count - full);
+		for (full /= 2; full > 0; full /= 2)
+			this->compress_(head, parent, full);
+		++rebuilds;
+		rebuiltNodes_ += count;
+	}
+
+	// Next node of the original tree in key order, skipping the ones
+	// inserted since the rebalance began.
+	node_ptr nextOriginal_(node_ptr node) const
+	{
+		do
+			node = walkNext(node);
+		while (node != nullptr && incremental->fresh.count(node) != 0);
+		return node;
+	}
+
+	// Runs the build stack until it has copied one key. Returns false once
+	// the copy is complete.
+	bool copyStep_()
+	{
+		IncrementalBuild& build = *incremental;
+		node_ptr returned = nullptr;
+		while (!build.frames.empty())
+		{
+			BuildFrame& frame = build.frames.back();
+			if (frame.count == 0)
+			{
+				returned = nullptr;
+				build.frames.pop_back();
+			}
+			else if (frame.stage == 0)
+			{
+				frame.stage = 1;
+				build.frames.push_back({ frame.count / 2 });
+			}
+			else if (frame.stage == 1)
+			{
+				frame.node = build.nodes.create(build.cursor->value);
+				frame.node->left = returned;
+				if (returned)
+					returned->parent = frame.node;
+				frame.stage = 2;
+				std::ptrdiff_t right = frame.count - frame.count / 2 - 1;
+				build.cursor = this->nextOriginal_(build.cursor);
+				build.frames.push_back({ right });
+				return true;
+			}
+			else
+			{
+				frame.node->right = returned;
+				if (returned)
+					returned->parent = frame.node;
+				returned = frame.node;
+				build.frames.pop_back();
+			}
 		}
+		build.built = returned;
+		return false;
 	}
 
-	void postorder_(node_ptr node)
+	// Plain insert into the copy, for keys logged while it was built.
+	void replayStep_()
 	{
-		if (node != nullptr)
+		IncrementalBuild& build = *incremental;
+		const T& x = build.log[build.replayed++];
+		node_ptr node = build.nodes.create(x);
+		if (build.built == nullptr)
 		{
-			this->preorder_(node->left);
-			this->preorder_(node->right);
-			std::cout << node->value << " ";
+			build.built = node;
+			return;
+		}
+		node_ptr parent = build.built;
+		while (true)
+		{
+			node_ptr& next = x < parent->value ? parent->left : parent->right;
+			if (next == nullptr)
+			{
+				next = node;
+				node->parent = parent;
+				return;
+			}
+			parent = next;
 		}
 	}
 
-	void clear_(node_ptr node)
+	void destroyValues_(node_ptr top)
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			walkPostorder(top, [](node_ptr node) { std::destroy_at(&node->value); });
+	}
+
+	// Destroys at most budget values of the replaced tree and returns the
+	// budget left over.
+	std::size_t teardownStep_(std::size_t budget)
 	{
-		if (node != nullptr)
+		Teardown& old = *teardown;
+		for (; budget > 0 && old.next != nullptr; --budget)
 		{
-			clear_(node->left);
-			clear_(node->right);
-			delete node;
+			node_ptr node = old.next;
+			node_ptr parent = node->parent;
+			if (node == old.top)
+				old.next = nullptr;
+			else if (node == parent->left && parent->right)
+				old.next = walkDeepestFirst(parent->right);
+			else
+				old.next = parent;
+			std::destroy_at(&node->value);
 		}
+		if (old.next == nullptr)
+			teardown.reset();
+		return budget;
+	}
+
+	void cancelIncremental_()
+	{
+		if (!incremental)
+			return;
+		this->destroyValues_(incremental->built);
+		for (BuildFrame& frame : incremental->frames)
+			this->destroyValues_(frame.node);
+		incremental.reset();
+	}
+
+	template <class It>
+	static node_ptr buildFromSorted_(NodeArena<BinaryNode<T>>& nodes, It first, std::ptrdiff_t count, node_ptr parent)
+	{
+		if (count == 0)
+			return nullptr;
+		std::ptrdiff_t half = count / 2;
+		node_ptr node = nodes.create(first[half]);
+		node->parent = parent;
+		node->left = buildFromSorted_(nodes, first, half, node);
+		node->right = buildFromSorted_(nodes, first + half + 1, count - half - 1, node);
+		return node;
+	}
+
+	// The left half is offered to other workers while this one builds the
+	// right half; each worker allocates from its own arena.
+	template <class It>
+	static node_ptr buildParallel_(tasks::ThreadPool& pool, std::vector<NodeArena<BinaryNode<T>>>& arenas,
+		It first, std::ptrdiff_t count, node_ptr parent, std::ptrdiff_t grain)
+	{
+		NodeArena<BinaryNode<T>>& nodes = arenas[pool.workerIndex()];
+		if (count <= grain)
+			return buildFromSorted_(nodes, first, count, parent);
+		std::ptrdiff_t half = count / 2;
+		node_ptr node = nodes.create(first[half]);
+		node->parent = parent;
+		tasks::TaskGroup group(pool);
+		group.run([&] { node->left = buildParallel_(pool, arenas, first, half, node, grain); });
+		node->right = buildParallel_(pool, arenas, first + half + 1, count - half - 1, node, grain);
+		group.wait();
+		return node;
 	}
 
 public:
 
+	BinaryTree() = default;
+	BinaryTree(const BinaryTree&) = delete;
+	BinaryTree& operator=(const BinaryTree&) = delete;
+
 	~BinaryTree()
 	{
-		this->clear_(root);
+		this->clear_();
 	}
 
 	struct Iterator
@@ -211,16 +582,18 @@ public:
 	template <class U>
 	void insert(U&& x)
 	{
+		if (policy.mode == RebuildMode::Incremental && policy.stepsPerInsert > 0 && this->rebalancing())
+			this->rebalanceStep(policy.stepsPerInsert);
 		++size_;
 		if (root == nullptr)
 		{
-			root = new BinaryNode<T>(std::forward<U>(x));
+			root = arena.create(std::forward<U>(x));
 			return;
 		}
 		if (x >= root->value)
-			this->insert_right(root->right, root, std::forward<U>(x));
+			this->insert_right(root->right, root, std::forward<U>(x), 1);
 		else if (x < root->value)
-			this->insert_left(root->left, root, std::forward<U>(x));
+			this->insert_left(root->left, root, std::forward<U>(x), 1);
 	}
 
 	node_ptr search(const T& x)
@@ -236,6 +609,97 @@ public:
 		return current;
 	}
 
+	// Resolves keys[i] into out[i] (nullptr when missing). Descents run in
+	// groups that advance one level per round and prefetch the next child,
+	// so the cache misses of a whole group overlap.
+	void search_batch(std::span<const T> keys, std::span<node_ptr> out) const
+	{
+		std::size_t count = std::min(keys.size(), out.size());
+		for (std::size_t first = 0; first < count; first += SEARCH_BATCH_WIDTH)
+		{
+			std::size_t lanes = std::min(SEARCH_BATCH_WIDTH, count - first);
+			const T* batchKeys = keys.data() + first;
+			node_ptr* cursor = out.data() + first;
+
+			std::uint32_t pending = 0;
+			for (std::size_t i = 0; i < lanes; ++i)
+			{
+				cursor[i] = root;
+				pending |= std::uint32_t(1) << i;
+			}
+			prefetchNode(root);
+
+			while (pending != 0)
+			{
+				for (std::size_t i = 0; i < lanes; ++i)
+				{
+					std::uint32_t bit = std::uint32_t(1) << i;
+					if ((pending & bit) == 0)
+						continue;
+					node_ptr node = cursor[i];
+					if (node == nullptr || node->value == batchKeys[i])
+					{
+						pending &= ~bit;
+						continue;
+					}
+					node = batchKeys[i] < node->value ? node->left : node->right;
+					prefetchNode(node);
+					cursor[i] = node;
+				}
+			}
+		}
+	}
+
+	// Removes one occurrence of x. A node with two children takes over its
+	// successor's value and the successor is unlinked instead. Cancels an
+	// incremental rebalance that is still running.
+	bool remove(const T& x)
+	{
+		node_ptr node = this->search(x);
+		if (node == nullptr)
+			return false;
+		this->cancelIncremental_();
+		if (node->left && node->right)
+		{
+			node_ptr successor = walkLeftmost(node->right);
+			node->value = std::move(successor->value);
+			node = successor;
+		}
+		node_ptr child = node->left ? node->left : node->right;
+		node_ptr parent = node->parent;
+		if (child)
+			child->parent = parent;
+		if (parent == nullptr)
+			root = child;
+		else if (parent->left == node)
+			parent->left = child;
+		else
+			parent->right = child;
+		arena.destroy(node);
+		--size_;
+		return true;
+	}
+
+	// Visits the values in [low, high] in order: one descent to the first
+	// of them, then successor steps along the parent links.
+	template <class F>
+	void visitRange(const T& low, const T& high, F&& visit) const
+	{
+		node_ptr first = nullptr;
+		for (node_ptr node = root; node != nullptr;)
+		{
+			if (node->value < low)
+				node = node->right;
+			else
+			{
+				first = node;
+				node = node->left;
+			}
+		}
+		for (node_ptr node = first; node != nullptr && !(high < node->value); node = walkNext(node))
+			visit(std::as_const(node->value));
+	}
+
 	node_ptr searchRecursive(const T& x)
 	{
 		return this->searchRecursive_(root, x);
@@ -261,28 +725,275 @@ public:
 		return this->depth_(root);
 	}
 
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		walkInorder(root, [&](node_ptr node) { visit(std::as_const(node->value)); });
+	}
+
+	template <class F>
+	void visitPreorder(F&& visit) const
+	{
+		walkPreorder(root, [&](node_ptr node) { visit(std::as_const(node->value)); });
+	}
+
+	template <class F>
+	void visitPostorder(F&& visit) const
+	{
+		walkPostorder(root, [&](node_ptr node) { visit(std::as_const(node->value)); });
+	}
+
+	template <class F>
+	void visitLevelorder(F&& visit) const
+	{
+		walkLevelorder(root, [&](node_ptr node) { visit(std::as_const(node->value)); });
+	}
+
 	void inorder()
 	{
-		this->inorder_(root);
+		this->visitInorder([](const T& x) { std::cout << x << " "; });
 		std::cout << std::endl;
 	}
 
 	void preorder()
 	{
-		this->preorder_(root);
+		this->visitPreorder([](const T& x) { std::cout << x << " "; });
 		std::cout << std::endl;
 	}
 
 	void postorder()
 	{
-		this->postorder_(root);
+		this->visitPostorder([](const T& x) { std::cout << x << " "; });
+		std::cout << std::endl;
+	}
+
+	void levelorder()
+	{
+		this->visitLevelorder([](const T& x) { std::cout << x << " "; });
 		std::cout << std::endl;
 	}
 
 	void clear()
 	{
-		delete root;
-		root = nullptr;
+		this->clear_();
+	}
+
+	// Replaces the contents with a perfectly balanced tree over the sorted
+	// range [first, last) in linear time.
+	template <class It>
+	void buildFromSorted(It first, It last)
+	{
+		this->clear_();
+		std::ptrdiff_t count = std::distance(first, last);
+		root = buildFromSorted_(arena, first, count, nullptr);
+		size_ = int(count);
+	}
+
+	// Same result as buildFromSorted, built by the workers of pool. The
+	// per-worker arenas are merged into the tree's arena afterwards.
+	template <class It>
+	void buildFromSortedParallel(It first, It last, tasks::ThreadPool& pool = tasks::ThreadPool::shared(),
+		std::size_t grain = PARALLEL_BUILD_GRAIN)
+	{
+		this->clear_();
+		std::ptrdiff_t count = std::distance(first, last);
+		std::ptrdiff_t leaf = std::ptrdiff_t(std::max<std::size_t>(grain, 1));
+		std::vector<NodeArena<BinaryNode<T>>> arenas(pool.threadCount());
+		{
+			tasks::TaskGroup group(pool);
+			group.run([&] { root = buildParallel_(pool, arenas, first, count, nullptr, leaf); });
+			group.wait();
+		}
+		for (NodeArena<BinaryNode<T>>& nodes : arenas)
+			arena.adopt(std::move(nodes));
+		size_ = int(count);
+	}
+
+	// Rebuilds the tree in place into one of minimal height, every level
+	// full except the last, using only rotations: O(n) time and O(1) extra
+	// space, with parent links kept valid throughout.
+	void rebalance()
+	{
+		this->cancelIncremental_();
+		this->rebuild_(root, nullptr);
+		rebuildPending_ = false;
+	}
+
+	// Starts rebuilding the tree into a balanced copy without a pause:
+	// rebalanceStep (or, under an Incremental policy, every insert) does a
+	// bounded amount of the work, amortized over the rebuild (see
+	// rebalanceStep). Until the copy replaces the tree at the
+	// last step, the original serves every call unchanged, so lookups cost
+	// what they did before and never see a half-built structure. The old
+	// tree is then torn down by the following steps. Needs memory for a
+	// second set of nodes while it runs, and does nothing if a rebalance is
+	// running already.
+	void beginRebalance()
+	{
+		if (this->rebalancing() || root == nullptr)
+			return;
+		incremental = std::make_unique<IncrementalBuild>();
+		incremental->cursor = walkLeftmost(root);
+		incremental->frames.push_back({ std::ptrdiff_t(size_) });
+	}
+
+	// Copies, replays or (once the copy has replaced the tree) destroys at
+	// most budget nodes. Returns true once no rebalance is running any more.
+	// The budget bounds the work of a call only amortized over the whole
+	// rebuild: copying one key walks to the next original node, which can
+	// climb the tree and skip any number of nodes inserted since the
+	// rebalance began, and the call that swaps in the copy frees the old
+	// arena's chunks at once when T needs no destructor. A single call can
+	// therefore take much longer than budget nodes' worth of work;
+	// benchmarks/BinaryTreeBench.cpp (rebalanceStepK) measures how much.
+	bool rebalanceStep(std::size_t budget)
+	{
+		if (incremental)
+		{
+			IncrementalBuild& build = *incremental;
+			for (; budget > 0; --budget)
+			{
+				if (!build.frames.empty())
+					this->copyStep_();
+				else if (build.replayed < build.log.size())
+					this->replayStep_();
+				else
+					break;
+			}
+			if (!build.frames.empty() || build.replayed < build.log.size())
+				return false;
+
+			// Old values that need no destructor go with their chunks at once.
+			if constexpr (std::is_trivially_destructible_v<T>)
+				arena = std::move(build.nodes);
+			else
+			{
+				teardown = std::make_unique<Teardown>(Teardown{ std::move(arena), root, walkDeepestFirst(root) });
+				arena = std::move(build.nodes);
+			}
+			root = build.built;
+			++rebuilds;
+			rebuiltNodes_ += std::size_t(size_);
+			incremental.reset();
+		}
+		if (teardown)
+			this->teardownStep_(budget);
+		return teardown == nullptr;
+	}
+
+	bool rebalancing() const
+	{
+		return incremental != nullptr || teardown != nullptr;
+	}
+
+	void setRebuildPolicy(const RebuildPolicy& newPolicy)
+	{
+		policy = newPolicy;
+	}
+
+	const RebuildPolicy& getRebuildPolicy() const
+	{
+		return policy;
+	}
+
+	// Runs the rebuild a Deferred policy has asked for, if any. Returns
+	// whether it did.
+	bool maintain()
+	{
+		if (!rebuildPending_)
+			return false;
+		this->rebalance();
+		return true;
+	}
+
+	bool rebuildPending() const
+	{
+		return rebuildPending_;
+	}
+
+	// Rebuilds run so far, whole-tree or subtree, and the nodes they moved.
+	std::size_t rebuildCount() const
+	{
+		return rebuilds;
+	}
+
+	std::size_t rebuiltNodes() const
+	{
+		return rebuiltNodes_;
+	}
+
+	// Writes the keys in order to a compact binary file, see TreeFile.h.
+	bool save(const std::string& path) const
+	{
+		return treefile::save<T>(path, std::uint64_t(size_), [this](auto& sink) { this->visitInorder(sink); });
+	}
+
+	// Replaces the contents with the keys saved at path, rebuilt balanced in
+	// linear time. Leaves the tree unchanged if the file cannot be read.
+	bool load(const std::string& path)
+	{
+		std::vector<T> keys;
+		if (!treefile::load(path, keys))
+			return false;
+		this->buildFromSorted(keys.begin(), keys.end());
+		return true;
+	}
+
+	// Node, arena and key memory of the tree. Chunk sizes are multiples of
+	// the slot size, so each chunk only adds an allocator header.
+	MemoryStats memory_stats() const
+	{
+		MemoryStats stats;
+		stats.nodes = arena.liveNodes();
+		stats.nodeBytes = stats.nodes * sizeof(BinaryNode<T>);
+		stats.arenaSlack = (arena.capacity() - stats.nodes) * arena.slotSize();
+		stats.allocatorOverhead = arena.chunkCount() * sizeof(void*)
+			+ stats.nodes * (arena.slotSize() - sizeof(BinaryNode<T>));
+		if constexpr (requires(const T& value) { value.capacity(); value.data(); })
+			walkInorder(root, [&](node_ptr node) { addOwnedHeap(stats, node->value); });
+		return stats;
+	}
+
+	// Depth histogram, leaves and path lengths in one pass. The top levels
+	// are collected serially until the tree is cut into subtrees of about
+	// grain nodes (if it is balanced), which the pool then measures in
+	// parallel.
+	ShapeStats shape_stats(tasks::ThreadPool& pool = tasks::ThreadPool::shared(),
+		std::size_t grain = PARALLEL_SHAPE_GRAIN) const
+	{
+		ShapeStats stats;
+		int cut = int(std::bit_width(std::size_t(size_) / std::max<std::size_t>(grain, 1)));
+		std::vector<node_ptr> frontier;
+		if (root != nullptr)
+			frontier.push_back(root);
+		for (int level = 0; level < cut && !frontier.empty(); ++level)
+		{
+			std::vector<node_ptr> next;
+			for (node_ptr node : frontier)
+			{
+				stats.addNode(level, node->left == nullptr && node->right == nullptr);
+				if (node->left)
+					next.push_back(node->left);
+				if (node->right)
+					next.push_back(node->right);
+			}
+			frontier = std::move(next);
+		}
+
+		std::vector<ShapeStats> parts(frontier.size());
+		auto measure = [&](std::size_t i) { measureShape_(frontier[i], parts[i]); };
+		if (frontier.size() == 1)
+			measure(0);
+		else
+		{
+			tasks::TaskGroup group(pool);
+			for (std::size_t i = 0; i < frontier.size(); ++i)
+				group.run([&, i] { measure(i); });
+			group.wait();
+		}
+		for (const ShapeStats& part : parts)
+			stats.merge(part, cut);
+		return stats;
 	}
 
 	int minimumNodeDepth()
@@ -0,0 +1,179 @@
+// Mateusz Kawa
+
+#ifndef BINARY_TREE_MAP
+#define BINARY_TREE_MAP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "NodeArena.h"
+#include "TreeWalk.h"
+
+// Ordered key/value map with unique keys. Nodes hold only the key, the
+// links and the index of the value, which lives out of line in a deque. A
+// lookup therefore walks nodes as compact as BinaryTree's and touches the
+// value only once the key is found, whatever the size of V. References to
+// values stay valid until clear().
+
+template <class K>
+struct MapNode
+{
+	K key;
+	std::uint32_t value;
+	MapNode* right;
+	MapNode* left;
+	MapNode* parent;
+	template <class U>
+	MapNode(U&& key, std::uint32_t value)
+		: key(std::forward<U>(key)), value(value), right(nullptr), left(nullptr), parent(nullptr) {}
+};
+
+template <class K, class V>
+class BinaryTreeMap
+{
+public:
+	using node_ptr = MapNode<K>*;
+
+private:
+	node_ptr root = nullptr;
+	NodeArena<MapNode<K>> arena;
+	std::deque<V> values;
+
+	// Node holding key, or the node under which it would be inserted.
+	node_ptr descend_(const K& key) const
+	{
+		node_ptr parent = nullptr;
+		node_ptr node = root;
+		while (node != nullptr)
+		{
+			parent = node;
+			if (key < node->key)
+				node = node->left;
+			else if (node->key < key)
+				node = node->right;
+			else
+				return node;
+		}
+		return parent;
+	}
+
+	void clear_()
+	{
+		if constexpr (!std::is_trivially_destructible_v<K>)
+			walkPostorder(root, [](node_ptr node) { std::destroy_at(&node->key); });
+		arena.releaseAll();
+		values.clear();
+		root = nullptr;
+	}
+
+public:
+	BinaryTreeMap() = default;
+	BinaryTreeMap(const BinaryTreeMap&) = delete;
+	BinaryTreeMap& operator=(const BinaryTreeMap&) = delete;
+
+	~BinaryTreeMap()
+	{
+		this->clear_();
+	}
+
+	struct Iterator
+	{
+		BinaryTreeMap* map;
+		node_ptr current;
+
+		const K& key() const { return current->key; }
+		V& value() const { return map->values[current->value]; }
+		std::pair<const K&, V&> operator*() const { return { this->key(), this->value() }; }
+
+		Iterator& operator++()
+		{
+			if (current->right)
+				current = walkLeftmost(current->right);
+			else
+			{
+				node_ptr parent = current->parent;
+				while (parent != nullptr && current == parent->right)
+				{
+					current = parent;
+					parent = parent->parent;
+				}
+				current = parent;
+			}
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const { return current == other.current; }
+		bool operator!=(const Iterator& other) const { return current != other.current; }
+	};
+
+	Iterator find(const K& key)
+	{
+		node_ptr node = this->descend_(key);
+		if (node == nullptr || key < node->key || node->key < key)
+			return this->end();
+		return Iterator{ this, node };
+	}
+
+	bool contains(const K& key) const
+	{
+		node_ptr node = this->descend_(key);
+		return node != nullptr && !(key < node->key) && !(node->key < key);
+	}
+
+	// Inserts key with a value constructed from args unless key is already
+	// present. The second member tells whether an insertion took place.
+	template <class U, class... Args>
+	std::pair<Iterator, bool> try_emplace(U&& key, Args&&... args)
+	{
+		node_ptr parent = this->descend_(key);
+		if (parent != nullptr && !(key < parent->key) && !(parent->key < key))
+			return { Iterator{ this, parent }, false };
+
+		values.emplace_back(std::forward<Args>(args)...);
+		node_ptr node = arena.create(std::forward<U>(key), std::uint32_t(values.size() - 1));
+		node->parent = parent;
+		if (parent == nullptr)
+			root = node;
+		else if (node->key < parent->key)
+			parent->left = node;
+		else
+			parent->right = node;
+		return { Iterator{ this, node }, true };
+	}
+
+	template <class U>
+	V& operator[](U&& key)
+	{
+		return this->try_emplace(std::forward<U>(key)).first.value();
+	}
+
+	std::size_t size() const
+	{
+		return values.size();
+	}
+
+	bool empty() const
+	{
+		return root == nullptr;
+	}
+
+	void clear()
+	{
+		this->clear_();
+	}
+
+	template <class F>
+	void visitInorder(F&& visit)
+	{
+		walkInorder(root, [&](node_ptr node) { visit(std::as_const(node->key), values[node->value]); });
+	}
+
+	Iterator begin() { return Iterator{ this, root ? walkLeftmost(root) : nullptr }; }
+	Iterator end() { return Iterator{ this, nullptr }; }
+};
+
+#endif // !BINARY_TREE_MAP
@@ -0,0 +1,243 @@
+// Mateusz Kawa
+
+#ifndef COROUTINE_SEARCH
+#define COROUTINE_SEARCH
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "BinaryTree.h"
+#include "Prefetch.h"
+
+// Lookups written as coroutines that prefetch the next node and suspend, so a
+// round-robin scheduler can keep many descents in flight on one thread.
+
+namespace coro
+{
+	constexpr std::size_t DEFAULT_INTERLEAVE = 16;
+
+	// Finished frames are kept on per-thread free lists, one per 64-byte size
+	// class, so a steady stream of lookups stops hitting the global allocator
+	// once it is warm.
+	class FramePool
+	{
+	private:
+		static constexpr std::size_t GRANULE = 64;
+		static constexpr std::size_t CLASS_COUNT = 8;
+
+		struct Block { Block* next; };
+
+		Block* heads[CLASS_COUNT] = {};
+
+		static std::size_t sizeClass(std::size_t size) { return (size + GRANULE - 1) / GRANULE - 1; }
+
+	public:
+		~FramePool()
+		{
+			for (Block*& head : heads)
+				while (head)
+				{
+					Block* next = head->next;
+					::operator delete(head);
+					head = next;
+				}
+		}
+
+		static FramePool& local()
+		{
+			thread_local FramePool pool;
+			return pool;
+		}
+
+		void* allocate(std::size_t size)
+		{
+			std::size_t index = sizeClass(size);
+			if (index >= CLASS_COUNT)
+				return ::operator new(size);
+			if (Block* block = heads[index])
+			{
+				heads[index] = block->next;
+				return block;
+			}
+			return ::operator new((index + 1) * GRANULE);
+		}
+
+		void free(void* frame, std::size_t size)
+		{
+			std::size_t index = sizeClass(size);
+			if (index >= CLASS_COUNT)
+			{
+				::operator delete(frame);
+				return;
+			}
+			Block* block = static_cast<Block*>(frame);
+			block->next = heads[index];
+			heads[index] = block;
+		}
+	};
+
+	template <class R>
+	class LookupTask
+	{
+	public:
+		struct promise_type
+		{
+			R result{};
+
+			LookupTask get_return_object()
+			{
+				return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+			void return_value(R value) { result = std::move(value); }
+			void unhandled_exception() { std::terminate(); }
+
+			static void* operator new(std::size_t size) { return FramePool::local().allocate(size); }
+			static void operator delete(void* frame, std::size_t size) { FramePool::local().free(frame, size); }
+		};
+
+		LookupTask() = default;
+		LookupTask(LookupTask&& other) noexcept
+			: handle(std::exchange(other.handle, nullptr)) {}
+		LookupTask& operator=(LookupTask&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (handle)
+					handle.destroy();
+				handle = std::exchange(other.handle, nullptr);
+			}
+			return *this;
+		}
+		~LookupTask()
+		{
+			if (handle)
+				handle.destroy();
+		}
+
+		explicit operator bool() const { return static_cast<bool>(handle); }
+		bool done() const { return handle.done(); }
+		void resume() { handle.resume(); }
+		R& result() { return handle.promise().result; }
+
+	private:
+		std::coroutine_handle<promise_type> handle = nullptr;
+
+		explicit LookupTask(std::coroutine_handle<promise_type> handle)
+			: handle(handle) {}
+	};
+
+	// Issues the prefetch, then gives the scheduler a chance to run other
+	// lookups while the line is on its way.
+	struct PrefetchAwait
+	{
+		const void* address;
+
+		bool await_ready() const noexcept { return address == nullptr; }
+		void await_suspend(std::coroutine_handle<>) const noexcept { prefetchNode(address); }
+		void await_resume() const noexcept {}
+	};
+
+	template <class T>
+	LookupTask<BinaryNode<T>*> searchTask(BinaryNode<T>* node, T key)
+	{
+		co_await PrefetchAwait{ node };
+		while (node != nullptr && node->value != key)
+		{
+			node = key < node->value ? node->left : node->right;
+			co_await PrefetchAwait{ node };
+		}
+		co_return node;
+	}
+
+	// First node whose value is not less than key.
+	template <class T>
+	LookupTask<BinaryNode<T>*> lowerBoundTask(BinaryNode<T>* node, T key)
+	{
+		BinaryNode<T>* best = nullptr;
+		co_await PrefetchAwait{ node };
+		while (node != nullptr)
+		{
+			if (node->value < key)
+				node = node->right;
+			else
+			{
+				best = node;
+				node = node->left;
+			}
+			co_await PrefetchAwait{ node };
+		}
+		co_return best;
+	}
+
+	// Runs makeTask(keys[i]) for every key with at most `depth` tasks in
+	// flight, resuming them round-robin, and stores each result in out[i].
+	template <class Key, class R, class MakeTask>
+	void runInterleaved(std::span<const Key> keys, std::span<R> out, std::size_t depth, MakeTask&& makeTask)
+	{
+		std::size_t count = std::min(keys.size(), out.size());
+		if (depth == 0)
+			depth = 1;
+		depth = std::min(depth, count);
+
+		std::vector<LookupTask<R>> tasks(depth);
+		std::vector<std::size_t> slotKey(depth);
+		std::size_t next = 0;
+		for (std::size_t slot = 0; slot < depth; ++slot)
+		{
+			tasks[slot] = makeTask(keys[next]);
+			slotKey[slot] = next++;
+		}
+
+		std::size_t active = depth;
+		while (active != 0)
+		{
+			for (std::size_t slot = 0; slot < depth; ++slot)
+			{
+				LookupTask<R>& task = tasks[slot];
+				if (!task)
+					continue;
+				task.resume();
+				if (!task.done())
+					continue;
+
+				out[slotKey[slot]] = std::move(task.result());
+				if (next < count)
+				{
+					task = makeTask(keys[next]);
+					slotKey[slot] = next++;
+				}
+				else
+				{
+					task = LookupTask<R>();
+					--active;
+				}
+			}
+		}
+	}
+
+	template <class T>
+	void interleavedSearch(BinaryTree<T>& tree, std::span<const T> keys, std::span<BinaryNode<T>*> out,
+		std::size_t depth = DEFAULT_INTERLEAVE)
+	{
+		BinaryNode<T>* root = tree.getRoot();
+		runInterleaved(keys, out, depth, [root](const T& key) { return searchTask(root, key); });
+	}
+
+	template <class T>
+	void interleavedLowerBound(BinaryTree<T>& tree, std::span<const T> keys, std::span<BinaryNode<T>*> out,
+		std::size_t depth = DEFAULT_INTERLEAVE)
+	{
+		BinaryNode<T>* root = tree.getRoot();
+		runInterleaved(keys, out, depth, [root](const T& key) { return lowerBoundTask(root, key); });
+	}
+}
+
+#endif // !COROUTINE_SEARCH
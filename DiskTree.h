@@ -0,0 +1,837 @@
+// Mateusz Kawa
+
+#ifndef DISK_TREE
+#define DISK_TREE
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Disk-backed ordered multiset for key sets larger than memory. Keys live
+// in a B+tree of fixed-size pages in one file; only a bounded number of
+// pages is cached at a time, in a buffer pool with clock eviction. Every
+// page transfer is one positioned read or write.
+//
+// Page 0 holds the metadata. A node page starts with an 8-byte header
+// (u16 leaf flag, u16 key count, u32 next leaf) followed by its keys and,
+// for inner pages, its child page numbers. Leaves are chained left to right
+// for ordered iteration. Keys must be trivially copyable and are stored in
+// native byte order.
+
+namespace disk
+{
+	constexpr std::size_t PAGE_SIZE = 4096;
+	constexpr std::uint32_t NO_PAGE = 0xFFFFFFFFu;
+
+	class PageFile
+	{
+	private:
+#ifdef _WIN32
+		HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+		int handle = -1;
+#endif
+		std::uint32_t pages = 0;
+
+	public:
+		PageFile() = default;
+		PageFile(const PageFile&) = delete;
+		PageFile& operator=(const PageFile&) = delete;
+
+		~PageFile()
+		{
+			this->close();
+		}
+
+		// Opens or creates path for reading and writing. Fails if the file
+		// does not hold a whole number of pages.
+		bool open(const std::string& path)
+		{
+			this->close();
+#ifdef _WIN32
+			handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER length;
+			if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &length)
+				|| length.QuadPart % PAGE_SIZE != 0 || length.QuadPart / PAGE_SIZE >= NO_PAGE)
+			{
+				this->close();
+				return false;
+			}
+			pages = static_cast<std::uint32_t>(length.QuadPart / PAGE_SIZE);
+#else
+			handle = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+			if (handle < 0)
+				return false;
+			off_t length = ::lseek(handle, 0, SEEK_END);
+			if (length < 0 || length % off_t(PAGE_SIZE) != 0 || std::uint64_t(length) / PAGE_SIZE >= NO_PAGE)
+			{
+				this->close();
+				return false;
+			}
+			pages = static_cast<std::uint32_t>(length / PAGE_SIZE);
+#endif
+			return true;
+		}
+
+		void close()
+		{
+#ifdef _WIN32
+			if (handle != INVALID_HANDLE_VALUE)
+				CloseHandle(handle);
+			handle = INVALID_HANDLE_VALUE;
+#else
+			if (handle >= 0)
+				::close(handle);
+			handle = -1;
+#endif
+			pages = 0;
+		}
+
+		bool read(std::uint32_t page, unsigned char* buffer) const
+		{
+			std::uint64_t offset = std::uint64_t(page) * PAGE_SIZE;
+#ifdef _WIN32
+			OVERLAPPED position{};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD got = 0;
+			return ReadFile(handle, buffer, PAGE_SIZE, &got, &position) && got == PAGE_SIZE;
+#else
+			return ::pread(handle, buffer, PAGE_SIZE, off_t(offset)) == ssize_t(PAGE_SIZE);
+#endif
+		}
+
+		bool write(std::uint32_t page, const unsigned char* buffer)
+		{
+			std::uint64_t offset = std::uint64_t(page) * PAGE_SIZE;
+#ifdef _WIN32
+			OVERLAPPED position{};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD put = 0;
+			bool ok = WriteFile(handle, buffer, PAGE_SIZE, &put, &position) && put == PAGE_SIZE;
+#else
+			bool ok = ::pwrite(handle, buffer, PAGE_SIZE, off_t(offset)) == ssize_t(PAGE_SIZE);
+#endif
+			if (ok && page >= pages)
+				pages = page + 1;
+			return ok;
+		}
+
+		// Forces every write so far to the disk.
+		bool sync()
+		{
+#ifdef _WIN32
+			return handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+#else
+			return handle >= 0 && ::fsync(handle) == 0;
+#endif
+		}
+
+		// Reserves a page number at the end of the file. The page exists on
+		// disk once it is first written.
+		std::uint32_t allocate()
+		{
+			return pages++;
+		}
+
+		std::uint32_t pageCount() const
+		{
+			return pages;
+		}
+	};
+
+	struct PoolStats
+	{
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t writes = 0;
+	};
+
+	// Fixed set of page frames with clock (second chance) replacement. A
+	// fetched page stays pinned, and so cannot be evicted, until its PageRef
+	// goes away.
+	class BufferPool
+	{
+	private:
+		struct Frame
+		{
+			alignas(64) unsigned char data[PAGE_SIZE];
+			std::uint32_t page = NO_PAGE;
+			int pins = 0;
+			bool dirty = false;
+			bool referenced = false;
+		};
+
+		PageFile& file;
+		std::unique_ptr<Frame[]> frames;
+		std::size_t capacity;
+		std::size_t hand = 0;
+		std::unordered_map<std::uint32_t, std::size_t> resident;
+		PoolStats stats_;
+
+		bool writeBack_(Frame& frame)
+		{
+			if (!frame.dirty)
+				return true;
+			++stats_.writes;
+			if (!file.write(frame.page, frame.data))
+				return false;
+			frame.dirty = false;
+			return true;
+		}
+
+		// Every frame is pinned at most twice around the clock before a victim
+		// turns up; a pool whose frames are all pinned is a caller bug. Returns
+		// nullptr if the victim is dirty and cannot be written back.
+		Frame* victim_()
+		{
+			for (std::size_t step = 0;; ++step)
+			{
+				Frame& frame = frames[hand];
+				hand = (hand + 1) % capacity;
+				if (frame.pins > 0)
+					continue;
+				if (frame.referenced && step < 2 * capacity)
+				{
+					frame.referenced = false;
+					continue;
+				}
+				if (frame.page != NO_PAGE)
+				{
+					if (!this->writeBack_(frame))
+						return nullptr;
+					resident.erase(frame.page);
+				}
+				return &frame;
+			}
+		}
+
+	public:
+		class PageRef
+		{
+		private:
+			Frame* frame = nullptr;
+
+		public:
+			PageRef() = default;
+			explicit PageRef(Frame* frame)
+				: frame(frame) {}
+
+			PageRef(const PageRef&) = delete;
+			PageRef& operator=(const PageRef&) = delete;
+
+			PageRef(PageRef&& other) noexcept
+				: frame(std::exchange(other.frame, nullptr)) {}
+
+			PageRef& operator=(PageRef&& other) noexcept
+			{
+				if (this != &other)
+				{
+					this->release();
+					frame = std::exchange(other.frame, nullptr);
+				}
+				return *this;
+			}
+
+			~PageRef()
+			{
+				this->release();
+			}
+
+			void release()
+			{
+				if (frame != nullptr)
+					--frame->pins;
+				frame = nullptr;
+			}
+
+			unsigned char* data() const { return frame->data; }
+			std::uint32_t page() const { return frame->page; }
+			void markDirty() const { frame->dirty = true; }
+			explicit operator bool() const { return frame != nullptr; }
+		};
+
+		BufferPool(PageFile& file, std::size_t capacity)
+			: file(file), frames(new Frame[std::max<std::size_t>(capacity, 1)]), capacity(std::max<std::size_t>(capacity, 1))
+		{
+			resident.reserve(this->capacity);
+		}
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		~BufferPool()
+		{
+			this->flush();
+		}
+
+		// Returns the page pinned, reading it on a miss. An empty PageRef means
+		// the read, or the write-back that made room for it, failed.
+		PageRef fetch(std::uint32_t page)
+		{
+			auto found = resident.find(page);
+			if (found != resident.end())
+			{
+				++stats_.hits;
+				Frame& frame = frames[found->second];
+				frame.referenced = true;
+				++frame.pins;
+				return PageRef(&frame);
+			}
+			++stats_.misses;
+			Frame* frame = this->victim_();
+			if (frame == nullptr)
+				return PageRef();
+			frame->page = NO_PAGE;
+			if (!file.read(page, frame->data))
+				return PageRef();
+			return this->install_(*frame, page);
+		}
+
+		// Pins a zeroed frame for a freshly allocated page. An empty PageRef
+		// means no frame could be written back to make room.
+		PageRef create(std::uint32_t page)
+		{
+			Frame* frame = this->victim_();
+			if (frame == nullptr)
+				return PageRef();
+			std::memset(frame->data, 0, PAGE_SIZE);
+			PageRef ref = this->install_(*frame, page);
+			ref.markDirty();
+			return ref;
+		}
+
+		bool flush()
+		{
+			bool ok = true;
+			for (std::size_t i = 0; i < capacity; ++i)
+				if (frames[i].page != NO_PAGE)
+					ok = this->writeBack_(frames[i]) && ok;
+			return ok;
+		}
+
+		const PoolStats& stats() const { return stats_; }
+		void resetStats() { stats_ = PoolStats(); }
+		std::size_t frameCount() const { return capacity; }
+
+	private:
+		PageRef install_(Frame& frame, std::uint32_t page)
+		{
+			frame.page = page;
+			frame.pins = 1;
+			frame.dirty = false;
+			frame.referenced = true;
+			resident[page] = std::size_t(&frame - frames.get());
+			return PageRef(&frame);
+		}
+	};
+
+	template <class T>
+	class DiskTree
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "disk trees store keys as raw bytes");
+
+	private:
+		using PageRef = BufferPool::PageRef;
+
+		static constexpr std::size_t HEADER = 8;
+		static constexpr std::size_t LEAF_KEYS = (PAGE_SIZE - HEADER) / sizeof(T);
+		static constexpr std::size_t INNER_KEYS = (PAGE_SIZE - HEADER - 4) / (sizeof(T) + 4);
+		static constexpr char MAGIC[4] = { 'B', 'S', 'T', 'D' };
+
+		struct Meta
+		{
+			char magic[4];
+			std::uint32_t keyBytes;
+			std::uint32_t root;
+			std::uint32_t height;
+			std::uint64_t size;
+		};
+
+		// Byte-level accessors for one node page.
+		struct Node
+		{
+			unsigned char* bytes;
+
+			bool leaf() const { return load_<std::uint16_t>(0) != 0; }
+			void setLeaf(bool leaf) { store_<std::uint16_t>(0, leaf ? 1 : 0); }
+			std::size_t count() const { return load_<std::uint16_t>(2); }
+			void setCount(std::size_t count) { store_<std::uint16_t>(2, std::uint16_t(count)); }
+			std::uint32_t next() const { return load_<std::uint32_t>(4); }
+			void setNext(std::uint32_t page) { store_<std::uint32_t>(4, page); }
+
+			T key(std::size_t i) const { return load_<T>(HEADER + i * sizeof(T)); }
+			void setKey(std::size_t i, const T& key) { store_<T>(HEADER + i * sizeof(T), key); }
+			std::uint32_t child(std::size_t i) const { return load_<std::uint32_t>(childOffset_(i)); }
+			void setChild(std::size_t i, std::uint32_t page) { store_<std::uint32_t>(childOffset_(i), page); }
+
+			// Shifts keys [from, count) and, for inner pages, children
+			// [from + 1, count + 1) one slot right.
+			void openGap(std::size_t from)
+			{
+				std::size_t n = this->count();
+				std::memmove(bytes + HEADER + (from + 1) * sizeof(T), bytes + HEADER + from * sizeof(T), (n - from) * sizeof(T));
+				if (!this->leaf())
+					std::memmove(bytes + childOffset_(from + 2), bytes + childOffset_(from + 1), (n - from) * 4);
+			}
+
+			// First slot whose key is not less than (or, with upper, greater
+			// than) x.
+			std::size_t search(const T& x, bool upper) const
+			{
+				std::size_t low = 0;
+				std::size_t high = this->count();
+				while (low < high)
+				{
+					std::size_t middle = (low + high) / 2;
+					T key = this->key(middle);
+					if (upper ? !(x < key) : key < x)
+						low = middle + 1;
+					else
+						high = middle;
+				}
+				return low;
+			}
+
+		private:
+			static std::size_t childOffset_(std::size_t i) { return HEADER + INNER_KEYS * sizeof(T) + i * 4; }
+
+			template <class U>
+			U load_(std::size_t offset) const
+			{
+				U value;
+				std::memcpy(&value, bytes + offset, sizeof(U));
+				return value;
+			}
+
+			template <class U>
+			void store_(std::size_t offset, const U& value)
+			{
+				std::memcpy(bytes + offset, &value, sizeof(U));
+			}
+		};
+
+		struct Split
+		{
+			T separator;
+			std::uint32_t right;
+		};
+
+		PageFile file;
+		std::unique_ptr<BufferPool> pool;
+		Meta meta{};
+		bool open_ = false;
+		bool failed_ = false;
+
+		// Every page access goes through here, so that a failed read or write
+		// is remembered for good().
+		PageRef fetch_(std::uint32_t page)
+		{
+			PageRef ref = pool->fetch(page);
+			failed_ = failed_ || !ref;
+			return ref;
+		}
+
+		// The page number is only taken once the pool has a frame for it, so a
+		// failed create leaves no unreferenced page behind.
+		PageRef newPage_(bool leaf)
+		{
+			PageRef ref = pool->create(file.pageCount());
+			failed_ = failed_ || !ref;
+			if (!ref)
+				return ref;
+			file.allocate();
+			Node node{ ref.data() };
+			node.setLeaf(leaf);
+			node.setNext(NO_PAGE);
+			return ref;
+		}
+
+		// Inserts x below page, setting split if page had to split. A page is
+		// only changed once every page the change needs has been fetched, but
+		// a failure above a split leaf still leaves the right half reachable
+		// from the leaf chain alone.
+		bool insert_(std::uint32_t page, const T& x, std::optional<Split>& split)
+		{
+			PageRef ref = this->fetch_(page);
+			if (!ref)
+				return false;
+			Node node{ ref.data() };
+			if (node.leaf())
+			{
+				PageRef rightRef;
+				if (node.count() + 1 >= LEAF_KEYS && !(rightRef = this->newPage_(true)))
+					return false;
+				std::size_t slot = node.search(x, true);
+				node.openGap(slot);
+				node.setKey(slot, x);
+				node.setCount(node.count() + 1);
+				ref.markDirty();
+				if (!rightRef)
+					return true;
+
+				Node right{ rightRef.data() };
+				std::size_t keep = node.count() / 2;
+				std::size_t moved = node.count() - keep;
+				std::memcpy(rightRef.data() + HEADER, ref.data() + HEADER + keep * sizeof(T), moved * sizeof(T));
+				right.setCount(moved);
+				right.setNext(node.next());
+				node.setCount(keep);
+				node.setNext(rightRef.page());
+				split = Split{ right.key(0), rightRef.page() };
+				return true;
+			}
+
+			std::size_t slot = node.search(x, true);
+			std::uint32_t child = node.child(slot);
+			ref.release();
+			std::optional<Split> childSplit;
+			if (!this->insert_(child, x, childSplit))
+				return false;
+			if (!childSplit)
+				return true;
+
+			ref = this->fetch_(page);
+			if (!ref)
+				return false;
+			node = Node{ ref.data() };
+			PageRef rightRef;
+			if (node.count() + 1 >= INNER_KEYS && !(rightRef = this->newPage_(false)))
+				return false;
+			node.openGap(slot);
+			node.setKey(slot, childSplit->separator);
+			node.setChild(slot + 1, childSplit->right);
+			node.setCount(node.count() + 1);
+			ref.markDirty();
+			if (!rightRef)
+				return true;
+
+			Node right{ rightRef.data() };
+			std::size_t middle = node.count() / 2;
+			std::size_t moved = node.count() - middle - 1;
+			for (std::size_t i = 0; i < moved; ++i)
+			{
+				right.setKey(i, node.key(middle + 1 + i));
+				right.setChild(i, node.child(middle + 1 + i));
+			}
+			right.setChild(moved, node.child(node.count()));
+			right.setCount(moved);
+			T separator = node.key(middle);
+			node.setCount(middle);
+			split = Split{ separator, rightRef.page() };
+			return true;
+		}
+
+		// Leftmost leaf that can hold x, so runs of duplicates that straddle a
+		// split are found from their start. Empty if a page cannot be read.
+		PageRef findLeaf_(const T& x)
+		{
+			PageRef ref = this->fetch_(meta.root);
+			for (std::uint32_t level = 1; ref && level < meta.height; ++level)
+			{
+				Node node{ ref.data() };
+				ref = this->fetch_(node.child(node.search(x, false)));
+			}
+			return ref;
+		}
+
+		bool writeMeta_()
+		{
+			PageRef ref = this->fetch_(0);
+			if (!ref)
+				return false;
+			std::memset(ref.data(), 0, PAGE_SIZE);
+			std::memcpy(ref.data(), &meta, sizeof(meta));
+			ref.markDirty();
+			return true;
+		}
+
+		// The metadata has to point at a node page of the right kind; what
+		// lies below the root is only checked as it is read.
+		bool validMeta_()
+		{
+			if (std::memcmp(meta.magic, MAGIC, 4) != 0 || meta.keyBytes != sizeof(T) || meta.root == 0
+				|| meta.root >= file.pageCount() || meta.height == 0 || meta.height > file.pageCount())
+				return false;
+			PageRef ref = this->fetch_(meta.root);
+			if (!ref)
+				return false;
+			Node root{ ref.data() };
+			return root.leaf() == (meta.height == 1) && root.count() < (root.leaf() ? LEAF_KEYS : INNER_KEYS)
+				&& (root.leaf() || root.count() != 0);
+		}
+
+	public:
+		static constexpr std::size_t DEFAULT_POOL_PAGES = 1024;
+
+		DiskTree() = default;
+
+		DiskTree(const std::string& path, std::size_t poolPages = DEFAULT_POOL_PAGES)
+		{
+			this->open(path, poolPages);
+		}
+
+		DiskTree(const DiskTree&) = delete;
+		DiskTree& operator=(const DiskTree&) = delete;
+
+		~DiskTree()
+		{
+			this->close();
+		}
+
+		// Opens the tree stored at path, or creates an empty one if the file
+		// is new. poolPages bounds the memory used for cached pages. Fails if
+		// the file is not a tree of T keys.
+		bool open(const std::string& path, std::size_t poolPages = DEFAULT_POOL_PAGES)
+		{
+			this->close();
+			failed_ = false;
+			if (!file.open(path))
+				return false;
+			pool = std::make_unique<BufferPool>(file, std::max<std::size_t>(poolPages, 8));
+			bool valid;
+			if (file.pageCount() == 0)
+			{
+				std::memcpy(meta.magic, MAGIC, 4);
+				meta.keyBytes = sizeof(T);
+				meta.height = 1;
+				meta.size = 0;
+				PageRef metaRef = pool->create(0);
+				if (metaRef)
+					file.allocate();
+				PageRef rootRef = metaRef ? this->newPage_(true) : PageRef();
+				valid = metaRef && rootRef;
+				if (valid)
+				{
+					meta.root = rootRef.page();
+					metaRef.release();
+					valid = this->writeMeta_();
+				}
+			}
+			else
+			{
+				PageRef ref = this->fetch_(0);
+				valid = bool(ref);
+				if (valid)
+				{
+					std::memcpy(&meta, ref.data(), sizeof(meta));
+					ref.release();
+					valid = this->validMeta_();
+				}
+			}
+			if (!valid)
+			{
+				pool.reset();
+				file.close();
+				return false;
+			}
+			open_ = true;
+			return true;
+		}
+
+		// Writes back every dirty page and the metadata and forces them to
+		// the disk.
+		bool flush()
+		{
+			if (!open_)
+				return false;
+			bool ok = this->writeMeta_();
+			ok = pool->flush() && ok;
+			ok = file.sync() && ok;
+			failed_ = failed_ || !ok;
+			return ok;
+		}
+
+		bool close()
+		{
+			if (!open_)
+				return true;
+			bool ok = this->flush();
+			pool.reset();
+			file.close();
+			open_ = false;
+			return ok;
+		}
+
+		// False once any page failed to read or write since the tree was
+		// opened; an insert that failed may have left part of a split behind.
+		bool good() const
+		{
+			return open_ && !failed_;
+		}
+
+		// Returns false if a page could not be read or written; the key is then
+		// not counted, though it may already sit in its leaf.
+		bool insert(const T& x)
+		{
+			std::optional<Split> split;
+			if (!this->insert_(meta.root, x, split))
+				return false;
+			if (split)
+			{
+				PageRef rootRef = this->newPage_(false);
+				if (!rootRef)
+					return false;
+				Node root{ rootRef.data() };
+				root.setKey(0, split->separator);
+				root.setChild(0, meta.root);
+				root.setChild(1, split->right);
+				root.setCount(1);
+				meta.root = rootRef.page();
+				++meta.height;
+			}
+			++meta.size;
+			return true;
+		}
+
+		// False if x is absent or a page could not be read; good() tells the
+		// two apart.
+		bool search(const T& x)
+		{
+			PageRef ref = this->findLeaf_(x);
+			if (!ref)
+				return false;
+			Node node{ ref.data() };
+			std::size_t slot = node.search(x, false);
+			if (slot == node.count())
+			{
+				std::uint32_t next = node.next();
+				if (next == NO_PAGE)
+					return false;
+				ref = this->fetch_(next);
+				if (!ref)
+					return false;
+				node = Node{ ref.data() };
+				slot = 0;
+			}
+			return slot < node.count() && !(x < node.key(slot));
+		}
+
+		std::uint64_t size() const
+		{
+			return meta.size;
+		}
+
+		int depth() const
+		{
+			return int(meta.height);
+		}
+
+		const PoolStats& poolStats() const
+		{
+			return pool->stats();
+		}
+
+		void resetPoolStats()
+		{
+			pool->resetStats();
+		}
+
+		// Walks the leaf chain; keeps one leaf pinned at a time. A leaf that
+		// cannot be read ends the walk early, and good() turns false.
+		struct Iterator
+		{
+			DiskTree* tree;
+			PageRef leaf;
+			std::size_t slot = 0;
+
+			Iterator(DiskTree* tree, std::uint32_t page)
+				: tree(tree)
+			{
+				this->enter_(page);
+			}
+
+			T operator*() const { return Node{ leaf.data() }.key(slot); }
+
+			Iterator& operator++()
+			{
+				Node node{ leaf.data() };
+				if (++slot == node.count())
+					this->enter_(node.next());
+				return *this;
+			}
+
+			bool operator==(const Iterator& other) const
+			{
+				return this->position_() == other.position_();
+			}
+
+			bool operator!=(const Iterator& other) const
+			{
+				return !(*this == other);
+			}
+
+		private:
+			void enter_(std::uint32_t page)
+			{
+				slot = 0;
+				leaf.release();
+				while (page != NO_PAGE)
+				{
+					leaf = tree->fetch_(page);
+					if (!leaf)
+						return;
+					Node node{ leaf.data() };
+					if (node.count() != 0)
+						return;
+					page = node.next();
+				}
+				leaf.release();
+			}
+
+			std::pair<std::uint32_t, std::size_t> position_() const
+			{
+				return leaf ? std::pair(leaf.page(), slot) : std::pair(NO_PAGE, std::size_t(0));
+			}
+		};
+
+		Iterator begin()
+		{
+			PageRef ref = this->fetch_(meta.root);
+			for (std::uint32_t level = 1; ref && level < meta.height; ++level)
+				ref = this->fetch_(Node{ ref.data() }.child(0));
+			if (!ref)
+				return this->end();
+			std::uint32_t first = ref.page();
+			ref.release();
+			return Iterator(this, first);
+		}
+
+		Iterator end()
+		{
+			return Iterator(this, NO_PAGE);
+		}
+
+		template <class F>
+		void visitInorder(F&& visit)
+		{
+			for (Iterator it = this->begin(); it != this->end(); ++it)
+				visit(*it);
+		}
+	};
+}
+
+#endif // !DISK_TREE
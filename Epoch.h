@@ -0,0 +1,249 @@
+// Mateusz Kawa
+
+#ifndef EPOCH
+#define EPOCH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch-based reclamation shared by the concurrent trees. Readers pin the
+// current epoch while they hold pointers into a tree; memory retired by a
+// writer is freed only once every pinned thread has moved two epochs on.
+
+namespace epoch
+{
+	constexpr std::size_t MAX_THREADS = 256;
+	constexpr std::size_t RECLAIM_THRESHOLD = 128;
+
+	class Domain
+	{
+	private:
+		static constexpr std::uint64_t QUIESCENT = 0;
+
+		struct alignas(64) Slot
+		{
+			std::atomic<std::uint64_t> epoch{ QUIESCENT };
+			std::atomic<bool> claimed{ false };
+		};
+
+		struct Retired
+		{
+			void* pointer;
+			void (*destroy)(void*);
+			std::uint64_t epoch;
+		};
+
+		// Per-thread state: the claimed slot, the pin depth and the list of
+		// pointers this thread retired.
+		struct ThreadRecord
+		{
+			Domain* domain = nullptr;
+			Slot* slot = nullptr;
+			int depth = 0;
+			std::vector<Retired> retired;
+
+			~ThreadRecord()
+			{
+				if (domain == nullptr)
+					return;
+				domain->adoptOrphans_(retired);
+				slot->claimed.store(false, std::memory_order_release);
+			}
+		};
+
+		Domain() = default;
+
+		// Whatever exited threads left behind is freed with the domain.
+		~Domain()
+		{
+			for (Retired& entry : orphans)
+				entry.destroy(entry.pointer);
+		}
+
+		alignas(64) std::atomic<std::uint64_t> globalEpoch{ 1 };
+		Slot slots[MAX_THREADS];
+		std::mutex orphanLock;
+		std::vector<Retired> orphans;
+
+		ThreadRecord& record_()
+		{
+			thread_local ThreadRecord record;
+			if (record.domain == nullptr)
+			{
+				for (Slot& slot : slots)
+				{
+					bool expected = false;
+					if (!slot.claimed.load(std::memory_order_relaxed)
+						&& slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+					{
+						record.slot = &slot;
+						break;
+					}
+				}
+				if (record.slot == nullptr)
+					std::terminate();
+				record.domain = this;
+			}
+			return record;
+		}
+
+		void adoptOrphans_(std::vector<Retired>& retired)
+		{
+			std::lock_guard<std::mutex> lock(orphanLock);
+			orphans.insert(orphans.end(), retired.begin(), retired.end());
+			retired.clear();
+		}
+
+		bool tryAdvance_()
+		{
+			std::uint64_t current = globalEpoch.load(std::memory_order_seq_cst);
+			for (Slot& slot : slots)
+			{
+				if (!slot.claimed.load(std::memory_order_acquire))
+					continue;
+				std::uint64_t seen = slot.epoch.load(std::memory_order_seq_cst);
+				if (seen != QUIESCENT && seen != current)
+					return false;
+			}
+			return globalEpoch.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+		}
+
+		static void free_(std::vector<Retired>& retired, std::uint64_t safeBefore)
+		{
+			std::size_t kept = 0;
+			for (Retired& entry : retired)
+			{
+				if (entry.epoch + 2 <= safeBefore)
+					entry.destroy(entry.pointer);
+				else
+					retired[kept++] = entry;
+			}
+			retired.resize(kept);
+		}
+
+	public:
+		// RAII pin of the calling thread. Pins nest.
+		class Guard
+		{
+		private:
+			ThreadRecord* record;
+
+		public:
+			explicit Guard(Domain& domain)
+				: record(&domain.record_())
+			{
+				if (record->depth++ == 0)
+				{
+					std::uint64_t current = domain.globalEpoch.load(std::memory_order_relaxed);
+					record->slot->epoch.store(current, std::memory_order_seq_cst);
+					// Orders the pin before the reader's first link load, so a
+					// writer scanning the slots either sees the pin or has its
+					// unlink seen by the reader (the store-buffering case).
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+				}
+			}
+
+			Guard(const Guard&) = delete;
+			Guard& operator=(const Guard&) = delete;
+
+			~Guard()
+			{
+				if (--record->depth == 0)
+					record->slot->epoch.store(QUIESCENT, std::memory_order_release);
+			}
+		};
+
+		// The process-wide domain. A thread's record is bound to it on first use.
+		static Domain& global()
+		{
+			static Domain domain;
+			return domain;
+		}
+
+		Guard pin() { return Guard(*this); }
+
+		void retire(void* pointer, void (*destroy)(void*))
+		{
+			ThreadRecord& record = this->record_();
+			record.retired.push_back({ pointer, destroy, globalEpoch.load(std::memory_order_seq_cst) });
+			if (record.retired.size() >= RECLAIM_THRESHOLD)
+				this->reclaim();
+		}
+
+		template <class T>
+		void retire(T* pointer)
+		{
+			this->retire(pointer, [](void* p) { delete static_cast<T*>(p); });
+		}
+
+		// Frees whatever the calling thread (and exited threads) retired that
+		// no pinned reader can still reach.
+		void reclaim()
+		{
+			this->tryAdvance_();
+			std::uint64_t current = globalEpoch.load(std::memory_order_seq_cst);
+			free_(this->record_().retired, current);
+
+			std::unique_lock<std::mutex> lock(orphanLock, std::try_to_lock);
+			if (lock.owns_lock())
+				free_(orphans, current);
+		}
+
+		// Grace period: returns once every thread that was pinned when it was
+		// called has unpinned at least once, so no reader can still be on a
+		// path it entered before the writer's last store. Must not be called
+		// while pinned.
+		void waitForReaders()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::uint64_t target = globalEpoch.load(std::memory_order_seq_cst) + 2;
+			while (globalEpoch.load(std::memory_order_seq_cst) < target)
+				if (!this->tryAdvance_())
+					std::this_thread::yield();
+		}
+
+		// Waits until everything retired so far by this thread and by threads
+		// that have exited is freed. Must not be called while pinned.
+		void synchronize()
+		{
+			while (true)
+			{
+				this->tryAdvance_();
+				std::uint64_t current = globalEpoch.load(std::memory_order_seq_cst);
+				free_(this->record_().retired, current);
+				bool pending = !this->record_().retired.empty();
+				{
+					std::lock_guard<std::mutex> lock(orphanLock);
+					free_(orphans, current);
+					pending = pending || !orphans.empty();
+				}
+				if (!pending)
+					return;
+				std::this_thread::yield();
+			}
+		}
+	};
+
+	inline Domain::Guard pin()
+	{
+		return Domain::global().pin();
+	}
+
+	template <class T>
+	void retire(T* pointer)
+	{
+		Domain::global().retire(pointer);
+	}
+
+	inline void waitForReaders()
+	{
+		Domain::global().waitForReaders();
+	}
+}
+
+#endif // !EPOCH
@@ -0,0 +1,332 @@
+// Mateusz Kawa
+
+#ifndef FROZEN_TREE
+#define FROZEN_TREE
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "BinaryTree.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FROZEN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FROZEN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FROZEN_TARGET(isa)
+#endif
+
+// Immutable snapshot of a tree laid out as a static B-tree: every block is
+// one cache line of 16 sorted keys, and block k has its 17 children at
+// k * 17 + 1 ... k * 17 + 17. A block is resolved with one vector compare and
+// a movemask instead of a chain of branches.
+
+namespace frozen
+{
+	constexpr std::size_t BLOCK_KEYS = 16;
+	constexpr std::size_t BLOCK_ALIGN = 64;
+
+	enum class Kernel
+	{
+		Scalar, SSE4, AVX2
+	};
+
+	inline const char* kernelName(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case Kernel::SSE4:
+			return "sse4";
+		case Kernel::AVX2:
+			return "avx2";
+		default:
+			return "scalar";
+		}
+	}
+
+	inline bool kernelSupported(Kernel kernel)
+	{
+#if FROZEN_X86
+#if defined(__GNUC__) || defined(__clang__)
+		switch (kernel)
+		{
+		case Kernel::SSE4:
+			return __builtin_cpu_supports("sse4.1");
+		case Kernel::AVX2:
+			return __builtin_cpu_supports("avx2");
+		default:
+			return true;
+		}
+#else
+		int info[4];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		bool avx2 = osAvx && (info[1] & (1 << 5)) != 0;
+		switch (kernel)
+		{
+		case Kernel::SSE4:
+			return sse41;
+		case Kernel::AVX2:
+			return avx2;
+		default:
+			return true;
+		}
+#endif
+#else
+		return kernel == Kernel::Scalar;
+#endif
+	}
+
+	// Widest kernel the CPU has. SSE4 stays ahead of scalar: the harness
+	// (BM_frozen*) puts it 6-15% faster while the blocks are cached; once
+	// every level misses, memory latency decides and the two trade places.
+	inline Kernel detectKernel()
+	{
+		if (kernelSupported(Kernel::AVX2))
+			return Kernel::AVX2;
+		if (kernelSupported(Kernel::SSE4))
+			return Kernel::SSE4;
+		return Kernel::Scalar;
+	}
+
+	inline std::size_t childBlock(std::size_t block, std::size_t slot)
+	{
+		return block * (BLOCK_KEYS + 1) + slot + 1;
+	}
+
+	// Each kernel returns the number of keys in the block that are less than x.
+	template <class T>
+	std::size_t rankScalar(const T* keys, T x)
+	{
+		std::size_t rank = 0;
+		for (std::size_t i = 0; i < BLOCK_KEYS; ++i)
+			rank += keys[i] < x;
+		return rank;
+	}
+
+	template <class T>
+	const T* lowerBoundScalar(const T* keys, std::size_t blockCount, T x)
+	{
+		const T* best = nullptr;
+		std::size_t block = 0;
+		while (block < blockCount)
+		{
+			const T* slots = keys + block * BLOCK_KEYS;
+			std::size_t slot = rankScalar(slots, x);
+			if (slot < BLOCK_KEYS)
+				best = slots + slot;
+			block = childBlock(block, slot);
+		}
+		return best;
+	}
+
+#if FROZEN_X86
+	template <class T>
+	FROZEN_TARGET("sse4.1,popcnt")
+	std::size_t rankSse4(const T* keys, T x)
+	{
+		unsigned mask = 0;
+		if constexpr (std::is_same_v<T, float>)
+		{
+			__m128 needle = _mm_set1_ps(x);
+			for (int i = 0; i < 4; ++i)
+			{
+				__m128 block = _mm_load_ps(keys + 4 * i);
+				mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(block, needle))) << (4 * i);
+			}
+		}
+		else
+		{
+			// Unsigned keys are compared as signed after flipping the sign bit.
+			const __m128i flip = _mm_set1_epi32(std::is_signed_v<T> ? 0 : INT32_MIN);
+			__m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<std::int32_t>(x)), flip);
+			for (int i = 0; i < 4; ++i)
+			{
+				__m128i block = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(keys) + i), flip);
+				__m128i less = _mm_cmpgt_epi32(needle, block);
+				mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(less))) << (4 * i);
+			}
+		}
+		return static_cast<std::size_t>(std::popcount(mask));
+	}
+
+	template <class T>
+	FROZEN_TARGET("sse4.1,popcnt")
+	const T* lowerBoundSse4(const T* keys, std::size_t blockCount, T x)
+	{
+		const T* best = nullptr;
+		std::size_t block = 0;
+		while (block < blockCount)
+		{
+			const T* slots = keys + block * BLOCK_KEYS;
+			std::size_t slot = rankSse4(slots, x);
+			if (slot < BLOCK_KEYS)
+				best = slots + slot;
+			block = childBlock(block, slot);
+		}
+		return best;
+	}
+
+	template <class T>
+	FROZEN_TARGET("avx2,popcnt")
+	std::size_t rankAvx2(const T* keys, T x)
+	{
+		unsigned mask = 0;
+		if constexpr (std::is_same_v<T, float>)
+		{
+			__m256 needle = _mm256_set1_ps(x);
+			__m256 low = _mm256_load_ps(keys);
+			__m256 high = _mm256_load_ps(keys + 8);
+			mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(low, needle, _CMP_LT_OQ)))
+				| static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(high, needle, _CMP_LT_OQ))) << 8;
+		}
+		else
+		{
+			const __m256i flip = _mm256_set1_epi32(std::is_signed_v<T> ? 0 : INT32_MIN);
+			__m256i needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<std::int32_t>(x)), flip);
+			__m256i low = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(keys)), flip);
+			__m256i high = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(keys) + 1), flip);
+			mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, low))))
+				| static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, high)))) << 8;
+		}
+		return static_cast<std::size_t>(std::popcount(mask));
+	}
+
+	template <class T>
+	FROZEN_TARGET("avx2,popcnt")
+	const T* lowerBoundAvx2(const T* keys, std::size_t blockCount, T x)
+	{
+		const T* best = nullptr;
+		std::size_t block = 0;
+		while (block < blockCount)
+		{
+			const T* slots = keys + block * BLOCK_KEYS;
+			std::size_t slot = rankAvx2(slots, x);
+			if (slot < BLOCK_KEYS)
+				best = slots + slot;
+			block = childBlock(block, slot);
+		}
+		return best;
+	}
+#endif
+
+	template <class T>
+	class FrozenTree
+	{
+		static_assert(std::is_same_v<T, int> || std::is_same_v<T, std::int32_t>
+			|| std::is_same_v<T, std::uint32_t> || std::is_same_v<T, float>,
+			"FrozenTree supports 32-bit int, uint32_t and float keys");
+
+	private:
+		struct AlignedDelete
+		{
+			void operator()(T* keys) const { ::operator delete[](keys, std::align_val_t(BLOCK_ALIGN)); }
+		};
+
+		std::unique_ptr<T[], AlignedDelete> keys;
+		std::size_t blockCount = 0;
+		std::size_t count = 0;
+		T largest{};
+		Kernel kernel = detectKernel();
+
+		// Unused slots sit after every key in order, so they must not compare
+		// below any key: for float that is +inf, not FLT_MAX.
+		static T padding_()
+		{
+			if constexpr (std::numeric_limits<T>::has_infinity)
+				return std::numeric_limits<T>::infinity();
+			else
+				return std::numeric_limits<T>::max();
+		}
+
+		// In-order fill of the implicit block tree from the sorted sequence.
+		void build_(std::size_t block, const T* sorted, std::size_t& next)
+		{
+			if (block >= blockCount)
+				return;
+			T* slots = keys.get() + block * BLOCK_KEYS;
+			for (std::size_t i = 0; i < BLOCK_KEYS; ++i)
+			{
+				this->build_(childBlock(block, i), sorted, next);
+				slots[i] = next < count ? sorted[next++] : padding_();
+			}
+			this->build_(childBlock(block, BLOCK_KEYS), sorted, next);
+		}
+
+	public:
+		FrozenTree(const T* sorted, std::size_t n)
+		{
+			this->assign(sorted, n);
+		}
+
+		explicit FrozenTree(BinaryTree<T>& tree)
+		{
+			std::vector<T> sorted;
+			sorted.reserve(static_cast<std::size_t>(tree.size()));
+			tree.visitInorder([&](const T& x) { sorted.push_back(x); });
+			this->assign(sorted.data(), sorted.size());
+		}
+
+		void assign(const T* sorted, std::size_t n)
+		{
+			count = n;
+			blockCount = (n + BLOCK_KEYS - 1) / BLOCK_KEYS;
+			keys.reset(static_cast<T*>(::operator new[](blockCount * BLOCK_KEYS * sizeof(T), std::align_val_t(BLOCK_ALIGN))));
+			std::size_t next = 0;
+			this->build_(0, sorted, next);
+			if (n != 0)
+				largest = sorted[n - 1];
+		}
+
+		// Falls back to the best supported kernel if `requested` is unavailable.
+		Kernel setKernel(Kernel requested)
+		{
+			kernel = kernelSupported(requested) ? requested : detectKernel();
+			return kernel;
+		}
+
+		Kernel getKernel() const { return kernel; }
+
+		// Smallest key that is not less than x, or nullptr.
+		const T* lower_bound(const T& x) const
+		{
+			if (count == 0 || largest < x)
+				return nullptr;
+			switch (kernel)
+			{
+#if FROZEN_X86
+			case Kernel::AVX2:
+				return lowerBoundAvx2(keys.get(), blockCount, x);
+			case Kernel::SSE4:
+				return lowerBoundSse4(keys.get(), blockCount, x);
+#endif
+			default:
+				return lowerBoundScalar(keys.get(), blockCount, x);
+			}
+		}
+
+		bool contains(const T& x) const
+		{
+			const T* found = this->lower_bound(x);
+			return found != nullptr && !(x < *found);
+		}
+
+		std::size_t size() const { return count; }
+	};
+}
+
+#endif // !FROZEN_TREE
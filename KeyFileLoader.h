@@ -0,0 +1,197 @@
+// Mateusz Kawa
+
+#ifndef KEY_FILE_LOADER
+#define KEY_FILE_LOADER
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "BinaryTree.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// Bulk ingest of text key files. The file is mapped, cut into chunks at
+// separator boundaries and every chunk is parsed with std::from_chars and
+// sorted by its own task. The sorted runs are then merged pairwise, also in
+// parallel, ready for the balanced bulk build: every merge is cut at co-ranks
+// into pieces of about MERGE_GRAIN keys, so the last rounds, which merge a
+// few long runs, keep the whole pool busy too. Keys may be separated by any
+// mix of newlines, commas, spaces and tabs.
+
+namespace ingest
+{
+	constexpr std::size_t CHUNK_BYTES = 1 << 22;
+	constexpr std::size_t MERGE_GRAIN = 1 << 16;
+
+	inline bool isSeparator(char c)
+	{
+		return c == '\n' || c == ',' || c == ' ' || c == '\r' || c == '\t';
+	}
+
+	template <class T>
+	bool parseChunk_(const char* first, const char* last, std::vector<T>& out)
+	{
+		while (true)
+		{
+			while (first != last && isSeparator(*first))
+				++first;
+			if (first == last)
+				return true;
+			T value;
+			auto [end, error] = std::from_chars(first, last, value);
+			if (error != std::errc() || (end != last && !isSeparator(*end)))
+				return false;
+			out.push_back(value);
+			first = end;
+		}
+	}
+
+	// Number of keys of a that come among the first k of the stable merge of
+	// a (length m) and b (length n).
+	template <class It>
+	std::size_t coRank_(std::size_t k, It a, std::size_t m, It b, std::size_t n)
+	{
+		std::size_t low = k > n ? k - n : 0;
+		std::size_t high = std::min(k, m);
+		while (low < high)
+		{
+			std::size_t i = low + (high - low) / 2;
+			if (!(b[k - i - 1] < a[i]))
+				low = i + 1;
+			else
+				high = i;
+		}
+		return low;
+	}
+
+	// Merges [first, middle) and [middle, last) into out, one task per
+	// MERGE_GRAIN keys of output.
+	template <class It, class Out>
+	void mergeParallel_(It first, It middle, It last, Out out, tasks::TaskGroup& group)
+	{
+		std::size_t m = std::size_t(middle - first);
+		std::size_t n = std::size_t(last - middle);
+		for (std::size_t begin = 0; begin < m + n; begin += MERGE_GRAIN)
+		{
+			std::size_t end = std::min(begin + MERGE_GRAIN, m + n);
+			group.run([=] {
+				std::size_t i = coRank_(begin, first, m, middle, n);
+				std::size_t j = coRank_(end, first, m, middle, n);
+				std::merge(first + i, first + j, middle + (begin - i), middle + (end - j), out + begin);
+			});
+		}
+	}
+
+	// Parses every key in [data, data + size) into keys, sorted. Returns false
+	// if any token is not a valid T.
+	template <class T>
+	bool parseKeys(const char* data, std::size_t size, std::vector<T>& keys,
+		tasks::ThreadPool& pool = tasks::ThreadPool::shared(), std::size_t chunkBytes = CHUNK_BYTES)
+	{
+		std::vector<std::size_t> bounds{ 0 };
+		for (std::size_t next = chunkBytes; next < size; next += chunkBytes)
+		{
+			next = std::max(next, bounds.back());
+			while (next < size && !isSeparator(data[next]))
+				++next;
+			if (next < size)
+				bounds.push_back(next);
+		}
+		bounds.push_back(size);
+		std::size_t chunks = bounds.size() - 1;
+
+		std::vector<std::vector<T>> parsed(chunks);
+		std::atomic<bool> valid{ true };
+		{
+			tasks::TaskGroup group(pool);
+			for (std::size_t i = 0; i < chunks; ++i)
+				group.run([&, i] {
+					if (!parseChunk_(data + bounds[i], data + bounds[i + 1], parsed[i]))
+						valid.store(false, std::memory_order_relaxed);
+					else
+						std::sort(parsed[i].begin(), parsed[i].end());
+				});
+			group.wait();
+		}
+		if (!valid.load(std::memory_order_relaxed))
+			return false;
+
+		std::vector<std::size_t> runs{ 0 };
+		for (const std::vector<T>& chunk : parsed)
+			runs.push_back(runs.back() + chunk.size());
+		keys.resize(runs.back());
+		{
+			tasks::TaskGroup group(pool);
+			for (std::size_t i = 0; i < chunks; ++i)
+				group.run([&, i] {
+					std::copy(parsed[i].begin(), parsed[i].end(), keys.begin() + runs[i]);
+					std::vector<T>().swap(parsed[i]);
+				});
+			group.wait();
+		}
+
+		// Each round merges neighbouring runs two at a time from keys into
+		// scratch, then the two swap roles.
+		std::vector<T> scratch(runs.size() > 2 ? keys.size() : 0);
+		while (runs.size() > 2)
+		{
+			std::vector<std::size_t> merged{ 0 };
+			tasks::TaskGroup group(pool);
+			for (std::size_t i = 0; i + 1 < runs.size(); i += 2)
+			{
+				auto first = keys.begin() + runs[i];
+				auto middle = keys.begin() + runs[i + 1];
+				auto out = scratch.begin() + runs[i];
+				if (i + 2 < runs.size())
+					mergeParallel_(first, middle, keys.begin() + runs[i + 2], out, group);
+				else
+					group.run([first, middle, out] { std::copy(first, middle, out); });
+				merged.push_back(runs[std::min(i + 2, runs.size() - 1)]);
+			}
+			group.wait();
+			keys.swap(scratch);
+			runs = std::move(merged);
+		}
+		return true;
+	}
+
+	// Reads a whole key file through a memory mapping. An empty file holds no
+	// keys; a missing one reads as an error.
+	template <class T>
+	bool loadKeys(const std::string& path, std::vector<T>& keys,
+		tasks::ThreadPool& pool = tasks::ThreadPool::shared())
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			// An empty file cannot be mapped.
+			std::error_code error;
+			if (!std::filesystem::is_regular_file(path, error) || std::filesystem::file_size(path, error) != 0 || error)
+				return false;
+			keys.clear();
+			return true;
+		}
+		return parseKeys(reinterpret_cast<const char*>(file.data()), file.size(), keys, pool);
+	}
+
+	// Replaces the contents of tree with the keys of a text file, built
+	// balanced by the pool. Leaves the tree unchanged on a parse error.
+	template <class T>
+	bool loadTree(BinaryTree<T>& tree, const std::string& path,
+		tasks::ThreadPool& pool = tasks::ThreadPool::shared())
+	{
+		std::vector<T> keys;
+		if (!loadKeys(path, keys, pool))
+			return false;
+		tree.buildFromSortedParallel(keys.begin(), keys.end(), pool);
+		return true;
+	}
+}
+
+#endif // !KEY_FILE_LOADER
@@ -0,0 +1,343 @@
+// Mateusz Kawa
+
+#ifndef LOCK_FREE_TREE
+#define LOCK_FREE_TREE
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Epoch.h"
+
+// Lock-free external binary search tree after Natarajan and Mittal (PPoPP
+// 2014). Keys live in leaves; internal nodes only route. A removal first
+// flags the edge to its leaf, then tags the sibling edge and swings the
+// nearest untagged ancestor edge past the parent with one CAS. Any thread
+// that meets a flagged or tagged edge helps finish that removal, so no
+// thread ever waits for another. Unlinked nodes go through epoch reclamation.
+//
+// The tree is a set: inserting a key that is already present returns false.
+// T must be default constructible for the three sentinel keys.
+
+template <class T>
+class LockFreeTree
+{
+private:
+	static constexpr std::uintptr_t FLAG = 1;
+	static constexpr std::uintptr_t TAG = 2;
+	static constexpr std::uintptr_t MARKS = FLAG | TAG;
+
+	struct Node
+	{
+		T key;
+		int infinity;
+		std::atomic<std::uintptr_t> left{ 0 };
+		std::atomic<std::uintptr_t> right{ 0 };
+		template <class U>
+		Node(U&& key, int infinity)
+			: key(std::forward<U>(key)), infinity(infinity) {}
+	};
+
+	struct SeekRecord
+	{
+		Node* ancestor;
+		Node* successor;
+		Node* parent;
+		Node* leaf;
+	};
+
+	Node* rootR;
+	Node* rootS;
+	std::atomic<int> size_{ 0 };
+
+	static Node* address_(std::uintptr_t field) { return reinterpret_cast<Node*>(field & ~MARKS); }
+	static std::uintptr_t edge_(Node* node) { return reinterpret_cast<std::uintptr_t>(node); }
+	static bool flagged_(std::uintptr_t field) { return (field & FLAG) != 0; }
+	static bool tagged_(std::uintptr_t field) { return (field & TAG) != 0; }
+
+	// Real keys sort below the sentinels, which sort by their rank.
+	static bool less_(const T& key, const Node* node)
+	{
+		return node->infinity != 0 || key < node->key;
+	}
+
+	static bool equals_(const T& key, const Node* node)
+	{
+		return node->infinity == 0 && key == node->key;
+	}
+
+	static std::atomic<std::uintptr_t>& childOf_(Node* node, const T& key)
+	{
+		return less_(key, node) ? node->left : node->right;
+	}
+
+	SeekRecord seek_(const T& key) const
+	{
+		SeekRecord record{ rootR, rootS, rootS, address_(rootS->left.load(std::memory_order_acquire)) };
+		std::uintptr_t parentField = rootS->left.load(std::memory_order_acquire);
+		std::uintptr_t currentField = record.leaf->left.load(std::memory_order_acquire);
+		Node* current = address_(currentField);
+
+		while (current != nullptr)
+		{
+			if (!tagged_(parentField))
+			{
+				record.ancestor = record.parent;
+				record.successor = record.leaf;
+			}
+			record.parent = record.leaf;
+			record.leaf = current;
+			parentField = currentField;
+			currentField = childOf_(current, key).load(std::memory_order_acquire);
+			current = address_(currentField);
+		}
+		return record;
+	}
+
+	// Everything between the successor and the parent is now unreachable: the
+	// chain nodes themselves, the flagged leaves hanging off them, and the
+	// parent's flagged child. The sibling that moved up stays.
+	void retireChain_(const T& key, const SeekRecord& record, Node* sibling)
+	{
+		Node* node = record.successor;
+		while (node != record.parent)
+		{
+			bool goLeft = less_(key, node);
+			Node* next = address_((goLeft ? node->left : node->right).load(std::memory_order_acquire));
+			Node* off = address_((goLeft ? node->right : node->left).load(std::memory_order_acquire));
+			epoch::retire(off);
+			epoch::retire(node);
+			node = next;
+		}
+		Node* left = address_(node->left.load(std::memory_order_acquire));
+		Node* right = address_(node->right.load(std::memory_order_acquire));
+		epoch::retire(left == sibling ? right : left);
+		epoch::retire(node);
+	}
+
+	bool cleanup_(const T& key, const SeekRecord& record)
+	{
+		Node* ancestor = record.ancestor;
+		Node* parent = record.parent;
+		std::atomic<std::uintptr_t>& successorEdge = childOf_(ancestor, key);
+
+		bool childLeft = less_(key, parent);
+		std::atomic<std::uintptr_t>* childEdge = childLeft ? &parent->left : &parent->right;
+		std::atomic<std::uintptr_t>* siblingEdge = childLeft ? &parent->right : &parent->left;
+		if (!flagged_(childEdge->load(std::memory_order_acquire)))
+			siblingEdge = childEdge;
+
+		std::uintptr_t siblingField = siblingEdge->fetch_or(TAG, std::memory_order_acq_rel);
+		Node* sibling = address_(siblingField);
+		std::uintptr_t expected = edge_(record.successor);
+		std::uintptr_t replacement = edge_(sibling) | (siblingField & FLAG);
+		if (!successorEdge.compare_exchange_strong(expected, replacement, std::memory_order_acq_rel))
+			return false;
+
+		this->retireChain_(key, record, sibling);
+		return true;
+	}
+
+	void clear_()
+	{
+		std::vector<Node*> pending{ rootR };
+		while (!pending.empty())
+		{
+			Node* node = pending.back();
+			pending.pop_back();
+			if (Node* left = address_(node->left.load(std::memory_order_relaxed)))
+				pending.push_back(left);
+			if (Node* right = address_(node->right.load(std::memory_order_relaxed)))
+				pending.push_back(right);
+			delete node;
+		}
+	}
+
+public:
+	// Sentinel ranks 1 < 2 < 3 stand for the paper's infinity0 < infinity1 <
+	// infinity2; rank 0 marks a real key.
+	LockFreeTree()
+	{
+		rootR = new Node(T{}, 3);
+		rootS = new Node(T{}, 2);
+		rootR->left.store(edge_(rootS), std::memory_order_relaxed);
+		rootR->right.store(edge_(new Node(T{}, 3)), std::memory_order_relaxed);
+		rootS->left.store(edge_(new Node(T{}, 1)), std::memory_order_relaxed);
+		rootS->right.store(edge_(new Node(T{}, 2)), std::memory_order_relaxed);
+	}
+
+	LockFreeTree(const LockFreeTree&) = delete;
+	LockFreeTree& operator=(const LockFreeTree&) = delete;
+
+	// Requires that no other thread is still using the tree.
+	~LockFreeTree()
+	{
+		this->clear_();
+	}
+
+	bool contains(const T& key) const
+	{
+		auto guard = epoch::pin();
+		return equals_(key, this->seek_(key).leaf);
+	}
+
+	template <class U>
+	bool insert(U&& x)
+	{
+		auto guard = epoch::pin();
+		Node* leaf = new Node(std::forward<U>(x), 0);
+		const T& key = leaf->key;
+		Node* internal = new Node(T{}, 0);
+		while (true)
+		{
+			SeekRecord record = this->seek_(key);
+			Node* found = record.leaf;
+			if (equals_(key, found))
+			{
+				delete leaf;
+				delete internal;
+				return false;
+			}
+
+			if (less_(key, found))
+			{
+				internal->key = found->key;
+				internal->infinity = found->infinity;
+				internal->left.store(edge_(leaf), std::memory_order_relaxed);
+				internal->right.store(edge_(found), std::memory_order_relaxed);
+			}
+			else
+			{
+				internal->key = key;
+				internal->infinity = 0;
+				internal->left.store(edge_(found), std::memory_order_relaxed);
+				internal->right.store(edge_(leaf), std::memory_order_relaxed);
+			}
+
+			std::atomic<std::uintptr_t>& childEdge = childOf_(record.parent, key);
+			std::uintptr_t expected = edge_(found);
+			if (childEdge.compare_exchange_strong(expected, edge_(internal), std::memory_order_acq_rel))
+			{
+				size_.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			if (address_(expected) == found && (expected & MARKS) != 0)
+				this->cleanup_(key, record);
+		}
+	}
+
+	bool remove(const T& key)
+	{
+		auto guard = epoch::pin();
+		bool injected = false;
+		Node* target = nullptr;
+		while (true)
+		{
+			SeekRecord record = this->seek_(key);
+			if (!injected)
+			{
+				target = record.leaf;
+				if (!equals_(key, target))
+					return false;
+				std::atomic<std::uintptr_t>& childEdge = childOf_(record.parent, key);
+				std::uintptr_t expected = edge_(target);
+				if (childEdge.compare_exchange_strong(expected, edge_(target) | FLAG, std::memory_order_acq_rel))
+				{
+					injected = true;
+					size_.fetch_sub(1, std::memory_order_relaxed);
+					if (this->cleanup_(key, record))
+						return true;
+				}
+				else if (address_(expected) == target && (expected & MARKS) != 0)
+					this->cleanup_(key, record);
+			}
+			else
+			{
+				if (record.leaf != target || this->cleanup_(key, record))
+					return true;
+			}
+		}
+	}
+
+	// Weakly consistent in-order walk over the real keys.
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<Node*> pending{ rootR };
+		while (!pending.empty())
+		{
+			Node* node = pending.back();
+			pending.pop_back();
+			Node* left = address_(node->left.load(std::memory_order_acquire));
+			if (left == nullptr)
+			{
+				if (node->infinity == 0)
+					visit(std::as_const(node->key));
+				continue;
+			}
+			pending.push_back(address_(node->right.load(std::memory_order_acquire)));
+			pending.push_back(left);
+		}
+	}
+
+	// Weakly consistent in-order walk over the real keys in [low, high]. A
+	// routing node sends keys below its own to the left and the rest to the
+	// right; sentinel routing nodes have only sentinels on their right.
+	template <class F>
+	void visitRange(const T& low, const T& high, F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<Node*> pending{ rootR };
+		while (!pending.empty())
+		{
+			Node* node = pending.back();
+			pending.pop_back();
+			Node* left = address_(node->left.load(std::memory_order_acquire));
+			if (left == nullptr)
+			{
+				if (node->infinity == 0 && !(node->key < low) && !(high < node->key))
+					visit(std::as_const(node->key));
+				continue;
+			}
+			if (node->infinity == 0 && !(high < node->key))
+				pending.push_back(address_(node->right.load(std::memory_order_acquire)));
+			if (less_(low, node))
+				pending.push_back(left);
+		}
+	}
+
+	int size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	// Levels from the top of the key subtree (below the two sentinels) down
+	// to the deepest leaf holding a key, routing nodes included; 0 when the
+	// tree is empty.
+	int depth() const
+	{
+		auto guard = epoch::pin();
+		int result = 0;
+		std::vector<std::pair<Node*, int>> pending{ { address_(rootS->left.load(std::memory_order_acquire)), 1 } };
+		while (!pending.empty())
+		{
+			auto [node, level] = pending.back();
+			pending.pop_back();
+			Node* left = address_(node->left.load(std::memory_order_acquire));
+			if (left == nullptr)
+			{
+				if (node->infinity == 0)
+					result = std::max(result, level);
+				continue;
+			}
+			pending.push_back({ address_(node->right.load(std::memory_order_acquire)), level + 1 });
+			pending.push_back({ left, level + 1 });
+		}
+		return result;
+	}
+};
+
+#endif // !LOCK_FREE_TREE
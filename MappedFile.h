@@ -0,0 +1,122 @@
+// Mateusz Kawa
+
+#ifndef MAPPED_FILE
+#define MAPPED_FILE
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are shared through the
+// OS page cache, so every process mapping the same file uses one copy.
+
+class MappedFile
+{
+private:
+	const unsigned char* data_ = nullptr;
+	std::size_t size_ = 0;
+
+	void unmap_()
+	{
+		if (data_ == nullptr)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+#else
+		munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+public:
+	MappedFile() = default;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept
+		: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			this->unmap_();
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+		}
+		return *this;
+	}
+
+	~MappedFile()
+	{
+		this->unmap_();
+	}
+
+	// Maps path, replacing any previous mapping. Returns false if the file
+	// cannot be opened or is empty.
+	bool open(const std::string& path)
+	{
+		this->unmap_();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER length;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr)
+			return false;
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (view == nullptr)
+			return false;
+		data_ = static_cast<const unsigned char*>(view);
+		size_ = static_cast<std::size_t>(length.QuadPart);
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		void* view = MAP_FAILED;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+			view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		if (view == MAP_FAILED)
+			return false;
+		data_ = static_cast<const unsigned char*>(view);
+		size_ = static_cast<std::size_t>(info.st_size);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+		this->unmap_();
+	}
+
+	const unsigned char* data() const { return data_; }
+	std::size_t size() const { return size_; }
+	bool isOpen() const { return data_ != nullptr; }
+};
+
+#endif // !MAPPED_FILE
@@ -0,0 +1,177 @@
+// Mateusz Kawa
+
+#ifndef MAPPED_TREE
+#define MAPPED_TREE
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "BinaryTree.h"
+#include "MappedFile.h"
+#include "Prefetch.h"
+#include "TreeFile.h"
+
+// Read-only tree searched in place inside a memory-mapped file. Keys are
+// stored in Eytzinger (BFS) order: the children of slot k are 2k and 2k + 1,
+// so the layout needs no pointers at all and is position independent.
+// Opening a file costs one mmap; pages are faulted in on first use and
+// shared with every other process mapping the same file.
+//
+//   header  "BSTE", u32 byte-order mark, u8 key kind, u8 key bytes,
+//           u16 reserved, u32 reserved, u64 key count, u64 keys offset
+//   keys    count + 1 slots in native byte order, slot 0 unused, starting
+//           at keys offset (a multiple of 64)
+
+namespace mapped
+{
+	constexpr char MAGIC[4] = { 'B', 'S', 'T', 'E' };
+	constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+	constexpr std::size_t HEADER_BYTES = 32;
+	constexpr std::size_t KEYS_ALIGN = 64;
+
+	template <class T>
+	constexpr std::uint8_t keyKind()
+	{
+		static_assert(std::is_arithmetic_v<T>, "mapped trees hold arithmetic keys");
+		return std::is_floating_point_v<T> ? 3 : std::is_signed_v<T> ? 1 : 2;
+	}
+
+	struct Header
+	{
+		char magic[4];
+		std::uint32_t byteOrder;
+		std::uint8_t kind;
+		std::uint8_t keyBytes;
+		std::uint16_t reserved0;
+		std::uint32_t reserved1;
+		std::uint64_t count;
+		std::uint64_t keysOffset;
+	};
+	static_assert(sizeof(Header) == HEADER_BYTES);
+
+	// Slot k of an Eytzinger array over n keys takes the key at the rank its
+	// in-order position has.
+	template <class T, class It>
+	void fillEytzinger_(std::vector<T>& slots, It& next, std::size_t k)
+	{
+		if (k >= slots.size())
+			return;
+		fillEytzinger_(slots, next, 2 * k);
+		slots[k] = *next++;
+		fillEytzinger_(slots, next, 2 * k + 1);
+	}
+
+	// Writes the sorted range [first, last) as a mapped tree file.
+	template <class T, class It>
+	bool write(const std::string& path, It first, It last)
+	{
+		std::vector<T> slots(std::size_t(std::distance(first, last)) + 1);
+		It next = first;
+		fillEytzinger_(slots, next, 1);
+
+		Header header{};
+		std::memcpy(header.magic, MAGIC, 4);
+		header.byteOrder = BYTE_ORDER_MARK;
+		header.kind = keyKind<T>();
+		header.keyBytes = sizeof(T);
+		header.count = slots.size() - 1;
+		header.keysOffset = KEYS_ALIGN;
+
+		treefile::FilePtr file = treefile::open(path, "wb");
+		if (!file)
+			return false;
+		unsigned char padding[KEYS_ALIGN] = {};
+		std::memcpy(padding, &header, sizeof(header));
+		return std::fwrite(padding, 1, KEYS_ALIGN, file.get()) == KEYS_ALIGN
+			&& std::fwrite(slots.data(), sizeof(T), slots.size(), file.get()) == slots.size()
+			&& std::fflush(file.get()) == 0;
+	}
+
+	template <class T>
+	bool write(const std::string& path, const BinaryTree<T>& tree)
+	{
+		std::vector<T> keys;
+		tree.visitInorder([&](const T& x) { keys.push_back(x); });
+		return write<T>(path, keys.begin(), keys.end());
+	}
+
+	template <class T>
+	class MappedTree
+	{
+	private:
+		// Slots per cache line; prefetching slot k * PREFETCH_STRIDE pulls in
+		// the line holding all descendants of k four levels down (for 4-byte
+		// keys).
+		static constexpr std::size_t PREFETCH_STRIDE = KEYS_ALIGN / sizeof(T);
+
+		MappedFile file;
+		const T* slots = nullptr;
+		std::size_t count = 0;
+
+	public:
+		MappedTree() = default;
+
+		explicit MappedTree(const std::string& path)
+		{
+			this->open(path);
+		}
+
+		// Maps path and checks its header. Returns false, leaving the tree
+		// empty, if the file is missing, truncated or holds another key type
+		// or byte order.
+		bool open(const std::string& path)
+		{
+			slots = nullptr;
+			count = 0;
+			if (!file.open(path) || file.size() < HEADER_BYTES)
+				return false;
+			Header header;
+			std::memcpy(&header, file.data(), sizeof(header));
+			bool valid = std::memcmp(header.magic, MAGIC, 4) == 0 && header.byteOrder == BYTE_ORDER_MARK
+				&& header.kind == keyKind<T>() && header.keyBytes == sizeof(T)
+				&& header.keysOffset % KEYS_ALIGN == 0 && header.keysOffset <= file.size()
+				&& header.count < (file.size() - header.keysOffset) / sizeof(T);
+			if (!valid)
+			{
+				file.close();
+				return false;
+			}
+			slots = reinterpret_cast<const T*>(file.data() + header.keysOffset);
+			count = std::size_t(header.count);
+			return true;
+		}
+
+		// Smallest key not less than x, or nullptr if every key is smaller.
+		// The pointer stays valid while the tree stays open.
+		const T* lower_bound(const T& x) const
+		{
+			std::size_t k = 1;
+			while (k <= count)
+			{
+				prefetchNode(slots + PREFETCH_STRIDE * k);
+				k = 2 * k + (slots[k] < x ? 1 : 0);
+			}
+			k >>= std::countr_one(k) + 1;
+			return k == 0 ? nullptr : slots + k;
+		}
+
+		bool contains(const T& x) const
+		{
+			const T* found = this->lower_bound(x);
+			return found != nullptr && !(x < *found);
+		}
+
+		std::size_t size() const
+		{
+			return count;
+		}
+	};
+}
+
+#endif // !MAPPED_TREE
@@ -0,0 +1,78 @@
+// Mateusz Kawa
+
+#ifndef MEMORY_STATS
+#define MEMORY_STATS
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+// Memory accounting shared by the trees. Node and arena figures are exact;
+// allocator overhead is estimated from a header of one pointer per
+// allocation plus rounding to two pointers, which is what the common
+// general-purpose allocators (glibc, the MSVC CRT heap) do.
+
+struct MemoryStats
+{
+	// Nodes currently in the tree.
+	std::size_t nodes = 0;
+	// Size of the node objects themselves.
+	std::size_t nodeBytes = 0;
+	// Heap memory owned by the nodes' members, e.g. string buffers.
+	std::size_t heapBytes = 0;
+	// Estimated allocator headers and rounding.
+	std::size_t allocatorOverhead = 0;
+	// Arena slots reserved but not holding a node.
+	std::size_t arenaSlack = 0;
+
+	std::size_t bytesInUse() const
+	{
+		return nodeBytes + heapBytes;
+	}
+
+	std::size_t reservedBytes() const
+	{
+		return this->bytesInUse() + allocatorOverhead + arenaSlack;
+	}
+
+	std::size_t bytesPerNode() const
+	{
+		return nodes == 0 ? 0 : this->reservedBytes() / nodes;
+	}
+
+	// Share of the reserved memory that holds no live data.
+	double fragmentation() const
+	{
+		std::size_t reserved = this->reservedBytes();
+		return reserved == 0 ? 0.0 : 1.0 - double(this->bytesInUse()) / double(reserved);
+	}
+};
+
+// Estimated header and rounding cost of one heap allocation of bytes.
+inline std::size_t allocationOverhead(std::size_t bytes)
+{
+	constexpr std::size_t ALIGN = 2 * sizeof(void*);
+	std::size_t block = (bytes + sizeof(void*) + ALIGN - 1) / ALIGN * ALIGN;
+	return block - bytes;
+}
+
+// Adds the buffer of a container-like value (std::string, std::vector, ...)
+// to stats when it lives outside the value itself.
+template <class T>
+void addOwnedHeap(MemoryStats& stats, const T& value)
+{
+	if constexpr (requires { value.capacity(); value.data(); })
+	{
+		const void* data = value.data();
+		const void* first = std::addressof(value);
+		const void* last = std::addressof(value) + 1;
+		std::less<const void*> before;
+		if (value.capacity() == 0 || (!before(data, first) && before(data, last)))
+			return;
+		std::size_t bytes = value.capacity() * sizeof(*value.data());
+		stats.heapBytes += bytes;
+		stats.allocatorOverhead += allocationOverhead(bytes);
+	}
+}
+
+#endif // !MEMORY_STATS
@@ -0,0 +1,136 @@
+// Mateusz Kawa
+
+#ifndef MVCC_TREE
+#define MVCC_TREE
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#include "PersistentTree.h"
+
+// Multi-version tree on top of PersistentTree. Every commit publishes a new
+// immutable version; readers open a handle on the latest version and can
+// scan it for as long as they like while writers keep committing. Writers
+// never wait for readers and readers never wait at all. A version, and the
+// nodes no newer version shares, is freed when its last handle goes away.
+
+template <class T>
+class MvccTree
+{
+private:
+	struct Version
+	{
+		PersistentTree<T> tree;
+		std::uint64_t number;
+		std::shared_ptr<std::atomic<int>> liveCount;
+
+		Version(PersistentTree<T> tree, std::uint64_t number, std::shared_ptr<std::atomic<int>> liveCount)
+			: tree(std::move(tree)), number(number), liveCount(std::move(liveCount))
+		{
+			this->liveCount->fetch_add(1, std::memory_order_relaxed);
+		}
+
+		~Version()
+		{
+			liveCount->fetch_sub(1, std::memory_order_relaxed);
+		}
+	};
+
+	// Shared with every version, since handles may outlive the tree.
+	std::shared_ptr<std::atomic<int>> liveVersions_ = std::make_shared<std::atomic<int>>(0);
+	std::atomic<std::shared_ptr<const Version>> current;
+	std::mutex writerLock;
+
+	void publish_(PersistentTree<T>&& tree, std::uint64_t number)
+	{
+		current.store(std::make_shared<const Version>(std::move(tree), number, liveVersions_), std::memory_order_release);
+	}
+
+public:
+	// Read-only view of one committed version. Iterators and pointers from
+	// the handle stay valid for as long as the handle exists.
+	class Handle
+	{
+	private:
+		std::shared_ptr<const Version> version;
+
+	public:
+		explicit Handle(std::shared_ptr<const Version> version)
+			: version(std::move(version)) {}
+
+		using Iterator = typename PersistentTree<T>::Iterator;
+
+		std::uint64_t number() const { return version->number; }
+		int size() const { return version->tree.size(); }
+		const T* search(const T& x) const { return version->tree.search(x); }
+		bool contains(const T& x) const { return version->tree.contains(x); }
+
+		template <class F>
+		void visitInorder(F&& visit) const
+		{
+			version->tree.visitInorder(std::forward<F>(visit));
+		}
+
+		Iterator begin() const { return version->tree.begin(); }
+		Iterator end() const { return version->tree.end(); }
+	};
+
+	MvccTree()
+	{
+		this->publish_(PersistentTree<T>(), 0);
+	}
+
+	MvccTree(const MvccTree&) = delete;
+	MvccTree& operator=(const MvccTree&) = delete;
+
+	Handle open() const
+	{
+		return Handle(current.load(std::memory_order_acquire));
+	}
+
+	// Applies update to a private copy of the latest version and publishes
+	// the result as one new version. Commits are serialised. An update that
+	// returns false changed nothing: no version is published and commit
+	// returns 0, a number no commit gets (it is the initial empty version's).
+	template <class F>
+	std::uint64_t commit(F&& update)
+	{
+		std::lock_guard<std::mutex> lock(writerLock);
+		std::shared_ptr<const Version> latest = current.load(std::memory_order_relaxed);
+		PersistentTree<T> next = latest->tree;
+		if constexpr (std::is_convertible_v<std::invoke_result_t<F&, PersistentTree<T>&>, bool>)
+		{
+			if (!update(next))
+				return 0;
+		}
+		else
+			update(next);
+		std::uint64_t number = latest->number + 1;
+		this->publish_(std::move(next), number);
+		return number;
+	}
+
+	template <class U>
+	std::uint64_t insert(U&& x)
+	{
+		return this->commit([&](PersistentTree<T>& tree) { tree.insert(std::forward<U>(x)); });
+	}
+
+	// Returns 0 without publishing a version when x is absent.
+	std::uint64_t remove(const T& x)
+	{
+		return this->commit([&](PersistentTree<T>& tree) { return tree.remove(x); });
+	}
+
+	// Versions still reachable from the tree or from open handles.
+	int liveVersions() const
+	{
+		return liveVersions_->load(std::memory_order_relaxed);
+	}
+};
+
+#endif // !MVCC_TREE
@@ -0,0 +1,185 @@
+// Mateusz Kawa
+
+#ifndef NODE_ARENA
+#define NODE_ARENA
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Chunked node allocator. Nodes are carved out of geometrically growing
+// chunks and freed nodes are recycled through an intrusive free list, so a
+// tree's nodes sit close together and clearing it releases a handful of
+// chunks instead of one allocation per node.
+
+template <class Node>
+class NodeArena
+{
+private:
+	static constexpr std::size_t FIRST_CHUNK = 64;
+	static constexpr std::size_t MAX_CHUNK = 1 << 16;
+
+	union Slot
+	{
+		Slot* next;
+		alignas(Node) unsigned char storage[sizeof(Node)];
+	};
+
+	struct Chunk
+	{
+		Slot* slots;
+		std::size_t capacity;
+	};
+
+	std::vector<Chunk> chunks;
+	Slot* freeList = nullptr;
+	std::size_t used = 0;
+	std::size_t nextCapacity = FIRST_CHUNK;
+	std::size_t live = 0;
+	std::size_t freeSlots = 0;
+
+	void grow_()
+	{
+		chunks.push_back({ new Slot[nextCapacity], nextCapacity });
+		used = 0;
+		if (nextCapacity < MAX_CHUNK)
+			nextCapacity *= 2;
+	}
+
+public:
+	NodeArena() = default;
+	NodeArena(const NodeArena&) = delete;
+	NodeArena& operator=(const NodeArena&) = delete;
+
+	NodeArena(NodeArena&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	NodeArena& operator=(NodeArena&& other) noexcept
+	{
+		if (this != &other)
+		{
+			this->releaseAll();
+			chunks = std::move(other.chunks);
+			freeList = std::exchange(other.freeList, nullptr);
+			used = std::exchange(other.used, 0);
+			nextCapacity = std::exchange(other.nextCapacity, FIRST_CHUNK);
+			live = std::exchange(other.live, 0);
+			freeSlots = std::exchange(other.freeSlots, 0);
+			other.chunks.clear();
+		}
+		return *this;
+	}
+
+	~NodeArena()
+	{
+		this->releaseAll();
+	}
+
+	template <class... Args>
+	Node* create(Args&&... args)
+	{
+		Slot* slot;
+		if (freeList != nullptr)
+		{
+			slot = freeList;
+			freeList = slot->next;
+			--freeSlots;
+		}
+		else
+		{
+			if (chunks.empty() || used == chunks.back().capacity)
+				this->grow_();
+			slot = chunks.back().slots + used++;
+		}
+		Node* node = ::new (static_cast<void*>(slot->storage)) Node(std::forward<Args>(args)...);
+		++live;
+		return node;
+	}
+
+	void destroy(Node* node)
+	{
+		std::destroy_at(node);
+		Slot* slot = reinterpret_cast<Slot*>(node);
+		slot->next = freeList;
+		freeList = slot;
+		++freeSlots;
+		--live;
+	}
+
+	// Frees every chunk without running node destructors; the owner must
+	// have destroyed whatever still needs it.
+	void releaseAll()
+	{
+		for (Chunk& chunk : chunks)
+			delete[] chunk.slots;
+		chunks.clear();
+		freeList = nullptr;
+		used = 0;
+		nextCapacity = FIRST_CHUNK;
+		live = 0;
+		freeSlots = 0;
+	}
+
+	// Takes over the chunks of another arena, e.g. one filled by a worker
+	// thread while building part of a tree. The other arena ends up empty.
+	void adopt(NodeArena&& other)
+	{
+		if (other.chunks.empty())
+			return;
+		if (chunks.empty())
+		{
+			*this = std::move(other);
+			return;
+		}
+		// The unused tail of the other arena's newest chunk joins the free
+		// list, and our own partially used chunk stays last so allocation
+		// continues in it.
+		Chunk& otherLast = other.chunks.back();
+		for (std::size_t i = other.used; i < otherLast.capacity; ++i)
+		{
+			otherLast.slots[i].next = freeList;
+			freeList = otherLast.slots + i;
+			++freeSlots;
+		}
+		Chunk current = chunks.back();
+		chunks.back() = other.chunks.front();
+		chunks.insert(chunks.end(), other.chunks.begin() + 1, other.chunks.end());
+		chunks.push_back(current);
+		while (Slot* slot = other.freeList)
+		{
+			other.freeList = slot->next;
+			slot->next = freeList;
+			freeList = slot;
+			++freeSlots;
+		}
+		live += other.live;
+		other.chunks.clear();
+		other.releaseAll();
+	}
+
+	std::size_t liveNodes() const { return live; }
+	std::size_t freeNodes() const { return freeSlots; }
+	std::size_t chunkCount() const { return chunks.size(); }
+
+	std::size_t capacity() const
+	{
+		std::size_t total = 0;
+		for (const Chunk& chunk : chunks)
+			total += chunk.capacity;
+		return total;
+	}
+
+	// Slots never handed out from the newest chunk.
+	std::size_t untouched() const
+	{
+		return chunks.empty() ? 0 : chunks.back().capacity - used;
+	}
+
+	static constexpr std::size_t slotSize() { return sizeof(Slot); }
+};
+
+#endif // !NODE_ARENA
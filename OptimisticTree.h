@@ -0,0 +1,397 @@
+// Mateusz Kawa
+
+#ifndef OPTIMISTIC_TREE
+#define OPTIMISTIC_TREE
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Epoch.h"
+
+// Binary search tree for concurrent readers and writers using optimistic
+// lock coupling. Each node carries a version word; writers descend without
+// locking, then lock only the node(s) they change and restart if a version
+// moved underneath them. Inserts into disjoint subtrees never touch the same
+// lock. Readers take no locks at all: values are immutable, links are
+// atomic and unlinked nodes are reclaimed through epochs.
+//
+// A node with two children is removed logically (marked deleted) and revived
+// if the same key is inserted again; nodes with at most one child are
+// spliced out. A deleted node that is down to one child is spliced out too,
+// right away by the remove that took its other child or else by the next
+// insert or remove that passes it. Every leaf and every one-child node is
+// then live, so deleted nodes never outnumber live ones.
+
+template <class T>
+class OptimisticTree
+{
+private:
+	static constexpr std::uint64_t OBSOLETE = 1;
+	static constexpr std::uint64_t LOCKED = 2;
+
+	struct Links
+	{
+		std::atomic<std::uint64_t> version{ 0 };
+		std::atomic<Links*> left{ nullptr };
+		std::atomic<Links*> right{ nullptr };
+	};
+
+	struct Node : Links
+	{
+		T value;
+		std::atomic<bool> deleted{ false };
+		template <class U>
+		Node(U&& x)
+			: value(std::forward<U>(x)) {}
+	};
+
+	// The header owns the link to the root so that the root can be replaced
+	// under the same locking protocol as any other child link.
+	Links header;
+	std::atomic<int> size_{ 0 };
+
+	static Node* node_(Links* links) { return static_cast<Node*>(links); }
+
+	static bool readLock_(Links* links, std::uint64_t& version)
+	{
+		version = links->version.load(std::memory_order_acquire);
+		return (version & (LOCKED | OBSOLETE)) == 0;
+	}
+
+	// Every read between readLock_ and validate_ is an acquire load, so the
+	// version check cannot be hoisted above them.
+	static bool validate_(Links* links, std::uint64_t version)
+	{
+		return links->version.load(std::memory_order_acquire) == version;
+	}
+
+	static bool upgrade_(Links* links, std::uint64_t version)
+	{
+		return links->version.compare_exchange_strong(version, version + LOCKED, std::memory_order_acquire);
+	}
+
+	static void unlock_(Links* links)
+	{
+		links->version.fetch_add(LOCKED, std::memory_order_release);
+	}
+
+	static void unlockObsolete_(Links* links)
+	{
+		links->version.fetch_add(LOCKED + OBSOLETE, std::memory_order_release);
+	}
+
+	static void backoff_(int& attempt)
+	{
+		if (++attempt > 8)
+			std::this_thread::yield();
+	}
+
+	static std::atomic<Links*>& childLink_(Links* parent, Links* child)
+	{
+		return parent->left.load(std::memory_order_relaxed) == child ? parent->left : parent->right;
+	}
+
+	// Splices current, which has at most one child, out of parent. Both
+	// must still be at the versions the caller read; returns false and
+	// changes nothing when either moved.
+	static bool splice_(Links* parent, std::uint64_t parentVersion, Links* current, std::uint64_t version)
+	{
+		if (!upgrade_(parent, parentVersion))
+			return false;
+		if (!upgrade_(current, version))
+		{
+			unlock_(parent);
+			return false;
+		}
+		Links* left = current->left.load(std::memory_order_relaxed);
+		childLink_(parent, current).store(left ? left : current->right.load(std::memory_order_relaxed), std::memory_order_release);
+		unlock_(parent);
+		unlockObsolete_(current);
+		epoch::retire(node_(current));
+		return true;
+	}
+
+	static bool hasTwoChildren_(Links* links)
+	{
+		return links->left.load(std::memory_order_acquire) != nullptr && links->right.load(std::memory_order_acquire) != nullptr;
+	}
+
+	void clear_()
+	{
+		std::vector<Links*> pending;
+		if (Links* root = header.right.load(std::memory_order_relaxed))
+			pending.push_back(root);
+		while (!pending.empty())
+		{
+			Links* links = pending.back();
+			pending.pop_back();
+			if (Links* left = links->left.load(std::memory_order_relaxed))
+				pending.push_back(left);
+			if (Links* right = links->right.load(std::memory_order_relaxed))
+				pending.push_back(right);
+			delete node_(links);
+		}
+		header.right.store(nullptr, std::memory_order_relaxed);
+	}
+
+public:
+	OptimisticTree() = default;
+	OptimisticTree(const OptimisticTree&) = delete;
+	OptimisticTree& operator=(const OptimisticTree&) = delete;
+
+	// Requires that no other thread is still using the tree.
+	~OptimisticTree()
+	{
+		this->clear_();
+	}
+
+	template <class U>
+	void insert(U&& x)
+	{
+		auto guard = epoch::pin();
+		for (int attempt = 0;; backoff_(attempt))
+		{
+			Links* parent = &header;
+			std::uint64_t parentVersion;
+			if (!readLock_(parent, parentVersion))
+				continue;
+			std::atomic<Links*>* link = &header.right;
+			Links* current = link->load(std::memory_order_acquire);
+			bool restart = false;
+
+			while (current != nullptr)
+			{
+				std::uint64_t version;
+				if (!readLock_(current, version) || !validate_(parent, parentVersion))
+				{
+					restart = true;
+					break;
+				}
+				Node* node = node_(current);
+				if (node->deleted.load(std::memory_order_acquire))
+				{
+					if (node->value == x)
+					{
+						if (!upgrade_(current, version))
+						{
+							restart = true;
+							break;
+						}
+						node->deleted.store(false, std::memory_order_release);
+						unlock_(current);
+						size_.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					if (!hasTwoChildren_(current))
+					{
+						splice_(parent, parentVersion, current, version);
+						restart = true;
+						break;
+					}
+				}
+				parent = current;
+				parentVersion = version;
+				link = x < node->value ? &current->left : &current->right;
+				current = link->load(std::memory_order_acquire);
+			}
+			if (restart || !upgrade_(parent, parentVersion))
+				continue;
+
+			link->store(new Node(std::forward<U>(x)), std::memory_order_release);
+			unlock_(parent);
+			size_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	bool remove(const T& x)
+	{
+		auto guard = epoch::pin();
+		for (int attempt = 0;; backoff_(attempt))
+		{
+			Links* grandparent = nullptr;
+			std::uint64_t grandparentVersion = 0;
+			Links* parent = &header;
+			std::uint64_t parentVersion;
+			if (!readLock_(parent, parentVersion))
+				continue;
+			Links* current = header.right.load(std::memory_order_acquire);
+			std::uint64_t version = 0;
+			bool restart = false;
+
+			while (current != nullptr)
+			{
+				if (!readLock_(current, version) || !validate_(parent, parentVersion))
+				{
+					restart = true;
+					break;
+				}
+				Node* node = node_(current);
+				if (node->deleted.load(std::memory_order_acquire))
+				{
+					if (!hasTwoChildren_(current))
+					{
+						splice_(parent, parentVersion, current, version);
+						restart = true;
+						break;
+					}
+				}
+				else if (node->value == x)
+					break;
+				grandparent = parent;
+				grandparentVersion = parentVersion;
+				parent = current;
+				parentVersion = version;
+				current = (x < node->value ? current->left : current->right).load(std::memory_order_acquire);
+			}
+			if (restart)
+				continue;
+			if (current == nullptr)
+				return false;
+
+			Node* node = node_(current);
+			Links* left = current->left.load(std::memory_order_acquire);
+			Links* right = current->right.load(std::memory_order_acquire);
+			if (left != nullptr && right != nullptr)
+			{
+				if (!upgrade_(current, version))
+					continue;
+				node->deleted.store(true, std::memory_order_release);
+				unlock_(current);
+				size_.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+
+			if (!upgrade_(parent, parentVersion))
+				continue;
+			if (!upgrade_(current, version))
+			{
+				unlock_(parent);
+				continue;
+			}
+			childLink_(parent, current).store(left ? left : right, std::memory_order_release);
+			unlockObsolete_(current);
+			epoch::retire(node);
+			size_.fetch_sub(1, std::memory_order_relaxed);
+
+			// A deleted parent that just lost its second child goes as well,
+			// while its lock is still held.
+			if (grandparent != nullptr && node_(parent)->deleted.load(std::memory_order_relaxed)
+				&& !hasTwoChildren_(parent) && upgrade_(grandparent, grandparentVersion))
+			{
+				Links* rest = parent->left.load(std::memory_order_relaxed);
+				childLink_(grandparent, parent).store(rest ? rest : parent->right.load(std::memory_order_relaxed),
+					std::memory_order_release);
+				unlock_(grandparent);
+				unlockObsolete_(parent);
+				epoch::retire(node_(parent));
+			}
+			else
+				unlock_(parent);
+			return true;
+		}
+	}
+
+	bool contains(const T& x) const
+	{
+		auto guard = epoch::pin();
+		Links* current = header.right.load(std::memory_order_acquire);
+		while (current != nullptr)
+		{
+			Node* node = node_(current);
+			if (node->value == x && !node->deleted.load(std::memory_order_acquire))
+				return true;
+			current = (x < node->value ? current->left : current->right).load(std::memory_order_acquire);
+		}
+		return false;
+	}
+
+	// Weakly consistent in-order walk that skips logically deleted nodes.
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<Links*> path;
+		Links* current = header.right.load(std::memory_order_acquire);
+		while (current != nullptr || !path.empty())
+		{
+			while (current != nullptr)
+			{
+				path.push_back(current);
+				current = current->left.load(std::memory_order_acquire);
+			}
+			current = path.back();
+			path.pop_back();
+			Node* node = node_(current);
+			if (!node->deleted.load(std::memory_order_acquire))
+				visit(std::as_const(node->value));
+			current = current->right.load(std::memory_order_acquire);
+		}
+	}
+
+	// Visits the live values in [low, high] in order, as weakly consistent as
+	// visitInorder. Subtrees wholly outside the range are not entered.
+	template <class F>
+	void visitRange(const T& low, const T& high, F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<Links*> path;
+		Links* current = header.right.load(std::memory_order_acquire);
+		while (current != nullptr || !path.empty())
+		{
+			while (current != nullptr)
+			{
+				if (node_(current)->value < low)
+					current = current->right.load(std::memory_order_acquire);
+				else
+				{
+					path.push_back(current);
+					current = current->left.load(std::memory_order_acquire);
+				}
+			}
+			if (path.empty())
+				return;
+			current = path.back();
+			path.pop_back();
+			Node* node = node_(current);
+			if (high < node->value)
+				return;
+			if (!node->deleted.load(std::memory_order_acquire))
+				visit(std::as_const(node->value));
+			current = current->right.load(std::memory_order_acquire);
+		}
+	}
+
+	int size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	// Levels on the longest root-to-leaf path. Deleted nodes still linked
+	// count, since lookups pass through them.
+	int depth() const
+	{
+		auto guard = epoch::pin();
+		int result = 0;
+		std::vector<std::pair<Links*, int>> pending;
+		if (Links* top = header.right.load(std::memory_order_acquire))
+			pending.push_back({ top, 1 });
+		while (!pending.empty())
+		{
+			auto [links, level] = pending.back();
+			pending.pop_back();
+			result = std::max(result, level);
+			if (Links* left = links->left.load(std::memory_order_acquire))
+				pending.push_back({ left, level + 1 });
+			if (Links* right = links->right.load(std::memory_order_acquire))
+				pending.push_back({ right, level + 1 });
+		}
+		return result;
+	}
+};
+
+#endif // !OPTIMISTIC_TREE
@@ -0,0 +1,138 @@
+// Mateusz Kawa
+
+#ifndef PARALLEL_TREE
+#define PARALLEL_TREE
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+#include "BinaryTree.h"
+#include "ThreadPool.h"
+#include "TreeWalk.h"
+
+// Fork/join traversals over a BinaryTree on the work-stealing pool. Nodes
+// carry no subtree sizes, so the split is driven by depth: a task walks down
+// one spine and forks the off-spine subtree at every node with two
+// children, until the depth at which a balanced tree of this size would be
+// down to the grain. Whatever is left is walked serially. A skewed tree
+// yields uneven tasks, which idle workers even out by stealing.
+
+namespace tasks
+{
+	// Subtrees expected to hold about this many nodes are not split further.
+	constexpr std::size_t PARALLEL_GRAIN = 1 << 14;
+
+	inline int forkDepth_(std::size_t size, std::size_t grain)
+	{
+		return int(std::bit_width(size / std::max<std::size_t>(grain, 1)));
+	}
+
+	template <class Node, class F>
+	void forEachSubtree_(ThreadPool& pool, Node* node, int depth, F& f)
+	{
+		TaskGroup group(pool);
+		for (; node != nullptr && depth > 0; --depth)
+		{
+			if (node->left && node->right)
+			{
+				Node* left = node->left;
+				group.run([&pool, left, depth, &f] { forEachSubtree_(pool, left, depth - 1, f); });
+				f(std::as_const(node->value));
+				node = node->right;
+			}
+			else
+			{
+				f(std::as_const(node->value));
+				node = node->left ? node->left : node->right;
+			}
+		}
+		walkPreorder(node, [&](Node* rest) { f(std::as_const(rest->value)); });
+		group.wait();
+	}
+
+	// Pieces left of the spine's tail are kept in prefix, pieces right of it
+	// in suffix (innermost first), so the result is combined in key order and
+	// op only needs to be associative.
+	template <class Node, class R, class Reduce, class Transform>
+	R reduceSubtree_(ThreadPool& pool, Node* node, int depth, const R& identity, Reduce& op, Transform& transform)
+	{
+		std::deque<R> prefix;
+		std::deque<R> suffix;
+		TaskGroup group(pool);
+		for (; node != nullptr && depth > 0; --depth)
+		{
+			if (node->left && node->right)
+			{
+				R& slot = prefix.emplace_back(identity);
+				Node* left = node->left;
+				group.run([&, left, depth] { slot = reduceSubtree_(pool, left, depth - 1, identity, op, transform); });
+				prefix.push_back(transform(std::as_const(node->value)));
+				node = node->right;
+			}
+			else if (node->left)
+			{
+				suffix.push_front(transform(std::as_const(node->value)));
+				node = node->left;
+			}
+			else
+			{
+				prefix.push_back(transform(std::as_const(node->value)));
+				node = node->right;
+			}
+		}
+		R tail = identity;
+		walkInorder(node, [&](Node* rest) { tail = op(std::move(tail), transform(std::as_const(rest->value))); });
+		group.wait();
+
+		R result = identity;
+		for (R& piece : prefix)
+			result = op(std::move(result), std::move(piece));
+		result = op(std::move(result), std::move(tail));
+		for (R& piece : suffix)
+			result = op(std::move(result), std::move(piece));
+		return result;
+	}
+
+	// Calls f(value) once for every node, concurrently and in no particular
+	// order.
+	template <class T, class F>
+	void parallel_for_each(BinaryTree<T>& tree, F f, ThreadPool& pool = ThreadPool::shared(),
+		std::size_t grain = PARALLEL_GRAIN)
+	{
+		int depth = forkDepth_(std::size_t(tree.size()), grain);
+		if (depth == 0)
+			return forEachSubtree_(pool, tree.getRoot(), 0, f);
+		TaskGroup group(pool);
+		group.run([&] { forEachSubtree_(pool, tree.getRoot(), depth, f); });
+		group.wait();
+	}
+
+	// Folds op over transform(value) in key order, starting from identity.
+	// op must be associative and identity its neutral element.
+	template <class T, class R, class Reduce, class Transform>
+	R parallel_transform_reduce(BinaryTree<T>& tree, R identity, Reduce op, Transform transform,
+		ThreadPool& pool = ThreadPool::shared(), std::size_t grain = PARALLEL_GRAIN)
+	{
+		int depth = forkDepth_(std::size_t(tree.size()), grain);
+		if (depth == 0)
+			return reduceSubtree_(pool, tree.getRoot(), 0, identity, op, transform);
+		R result = identity;
+		TaskGroup group(pool);
+		group.run([&] { result = reduceSubtree_(pool, tree.getRoot(), depth, identity, op, transform); });
+		group.wait();
+		return result;
+	}
+
+	template <class T, class R, class Reduce>
+	R parallel_reduce(BinaryTree<T>& tree, R identity, Reduce op,
+		ThreadPool& pool = ThreadPool::shared(), std::size_t grain = PARALLEL_GRAIN)
+	{
+		return parallel_transform_reduce(tree, std::move(identity), std::move(op),
+			[](const T& x) { return R(x); }, pool, grain);
+	}
+}
+
+#endif // !PARALLEL_TREE
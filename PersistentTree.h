@@ -0,0 +1,304 @@
+// Mateusz Kawa
+
+#ifndef PERSISTENT_TREE
+#define PERSISTENT_TREE
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Binary search tree with path copying. Nodes are immutable once published
+// and shared between versions through a reference count; an update copies
+// only the nodes on the path from the root to the change and leaves every
+// other subtree shared. Copying a PersistentTree is therefore O(1) and
+// yields a snapshot that later updates to either copy never disturb.
+//
+// Reference counts are atomic, so snapshots may be handed to other threads;
+// a single PersistentTree object is not itself synchronised.
+
+template <class T>
+struct PersistentNode
+{
+	T value;
+	const PersistentNode* left;
+	const PersistentNode* right;
+	mutable std::atomic<int> refs{ 1 };
+	template <class U>
+	PersistentNode(U&& x, const PersistentNode* left, const PersistentNode* right)
+		: value(std::forward<U>(x)), left(left), right(right) {}
+};
+
+template <class T>
+class PersistentTree
+{
+public:
+	using node_ptr = const PersistentNode<T>*;
+
+private:
+	node_ptr root = nullptr;
+	int size_ = 0;
+
+	static node_ptr retain_(node_ptr node)
+	{
+		if (node != nullptr)
+			node->refs.fetch_add(1, std::memory_order_relaxed);
+		return node;
+	}
+
+	// Iterative, so dropping the last version of a degenerate tree does not
+	// recurse once per node.
+	static void release_(node_ptr node)
+	{
+		std::vector<node_ptr> pending;
+		while (true)
+		{
+			if (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				pending.push_back(node->left);
+				pending.push_back(node->right);
+				delete node;
+			}
+			if (pending.empty())
+				return;
+			node = pending.back();
+			pending.pop_back();
+		}
+	}
+
+	// Copies the nodes of path from the bottom up, each with the child the
+	// path continued into replaced by the new subtree. Takes ownership of
+	// child.
+	static node_ptr copyPath_(const std::vector<node_ptr>& path, const std::vector<bool>& wentLeft, node_ptr child)
+	{
+		for (std::size_t i = path.size(); i-- > 0;)
+		{
+			node_ptr old = path[i];
+			child = wentLeft[i]
+				? new PersistentNode<T>(old->value, child, retain_(old->right))
+				: new PersistentNode<T>(old->value, retain_(old->left), child);
+		}
+		return child;
+	}
+
+	void publish_(node_ptr next)
+	{
+		release_(std::exchange(root, next));
+	}
+
+public:
+	PersistentTree() = default;
+
+	// O(1): the copy shares every node with this tree.
+	PersistentTree(const PersistentTree& other)
+		: root(retain_(other.root)), size_(other.size_) {}
+
+	PersistentTree(PersistentTree&& other) noexcept
+		: root(std::exchange(other.root, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+	PersistentTree& operator=(PersistentTree other) noexcept
+	{
+		std::swap(root, other.root);
+		std::swap(size_, other.size_);
+		return *this;
+	}
+
+	~PersistentTree()
+	{
+		release_(root);
+	}
+
+	PersistentTree snapshot() const
+	{
+		return *this;
+	}
+
+	struct Iterator
+	{
+		std::vector<node_ptr> path;
+
+		Iterator(node_ptr node)
+		{
+			this->descend_(node);
+		}
+
+		const T& operator*() const { return path.back()->value; }
+
+		Iterator& operator++()
+		{
+			node_ptr node = path.back();
+			path.pop_back();
+			this->descend_(node->right);
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			return this->current() == other.current();
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return this->current() != other.current();
+		}
+
+		node_ptr current() const
+		{
+			return path.empty() ? nullptr : path.back();
+		}
+
+	private:
+		void descend_(node_ptr node)
+		{
+			for (; node != nullptr; node = node->left)
+				path.push_back(node);
+		}
+	};
+
+	template <class U>
+	void insert(U&& x)
+	{
+		std::vector<node_ptr> path;
+		std::vector<bool> wentLeft;
+		for (node_ptr node = root; node != nullptr;)
+		{
+			path.push_back(node);
+			wentLeft.push_back(x < node->value);
+			node = wentLeft.back() ? node->left : node->right;
+		}
+		node_ptr leaf = new PersistentNode<T>(std::forward<U>(x), nullptr, nullptr);
+		this->publish_(copyPath_(path, wentLeft, leaf));
+		++size_;
+	}
+
+	// Removes one occurrence of x. A node with two children is replaced by a
+	// copy holding its successor's value, with the successor's path copied
+	// out of the right subtree.
+	bool remove(const T& x)
+	{
+		std::vector<node_ptr> path;
+		std::vector<bool> wentLeft;
+		node_ptr target = root;
+		while (target != nullptr && !(target->value == x))
+		{
+			path.push_back(target);
+			wentLeft.push_back(x < target->value);
+			target = wentLeft.back() ? target->left : target->right;
+		}
+		if (target == nullptr)
+			return false;
+
+		node_ptr replacement;
+		if (target->left == nullptr)
+			replacement = retain_(target->right);
+		else if (target->right == nullptr)
+			replacement = retain_(target->left);
+		else
+		{
+			std::vector<node_ptr> successorPath;
+			node_ptr successor = target->right;
+			while (successor->left != nullptr)
+			{
+				successorPath.push_back(successor);
+				successor = successor->left;
+			}
+			std::vector<bool> alwaysLeft(successorPath.size(), true);
+			node_ptr right = copyPath_(successorPath, alwaysLeft, retain_(successor->right));
+			replacement = new PersistentNode<T>(successor->value, retain_(target->left), right);
+		}
+		this->publish_(copyPath_(path, wentLeft, replacement));
+		--size_;
+		return true;
+	}
+
+	const T* search(const T& x) const
+	{
+		node_ptr current = root;
+		while (current != nullptr && !(current->value == x))
+			current = x < current->value ? current->left : current->right;
+		return current ? &current->value : nullptr;
+	}
+
+	bool contains(const T& x) const
+	{
+		return this->search(x) != nullptr;
+	}
+
+	int size() const
+	{
+		return size_;
+	}
+
+	int depth() const
+	{
+		int result = 0;
+		std::vector<std::pair<node_ptr, int>> pending;
+		if (root != nullptr)
+			pending.push_back({ root, 1 });
+		while (!pending.empty())
+		{
+			auto [node, level] = pending.back();
+			pending.pop_back();
+			result = std::max(result, level);
+			if (node->left)
+				pending.push_back({ node->left, level + 1 });
+			if (node->right)
+				pending.push_back({ node->right, level + 1 });
+		}
+		return result;
+	}
+
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		for (const T& x : *this)
+			visit(x);
+	}
+
+	// Visits the values in [low, high] in order. Subtrees wholly outside the
+	// range are not entered.
+	template <class F>
+	void visitRange(const T& low, const T& high, F&& visit) const
+	{
+		std::vector<node_ptr> path;
+		node_ptr node = root;
+		while (node != nullptr || !path.empty())
+		{
+			while (node != nullptr)
+			{
+				if (node->value < low)
+					node = node->right;
+				else
+				{
+					path.push_back(node);
+					node = node->left;
+				}
+			}
+			if (path.empty())
+				return;
+			node = path.back();
+			path.pop_back();
+			if (high < node->value)
+				return;
+			visit(node->value);
+			node = node->right;
+		}
+	}
+
+	void clear()
+	{
+		this->publish_(nullptr);
+		size_ = 0;
+	}
+
+	node_ptr getRoot() const
+	{
+		return root;
+	}
+
+	Iterator begin() const { return Iterator(root); }
+	Iterator end() const { return Iterator(nullptr); }
+};
+
+#endif // !PERSISTENT_TREE
@@ -0,0 +1,22 @@
+// Mateusz Kawa
+
+#ifndef PREFETCH
+#define PREFETCH
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#endif
+
+// Hint that `address` will be read soon. Prefetching nullptr is harmless.
+inline void prefetchNode(const void* address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(address, 0, 3);
+#elif defined(_M_IX86) || defined(_M_X64)
+	_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+	(void)address;
+#endif
+}
+
+#endif // !PREFETCH
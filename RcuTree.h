@@ -0,0 +1,242 @@
+// Mateusz Kawa
+
+#ifndef RCU_TREE
+#define RCU_TREE
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Epoch.h"
+
+// Binary search tree for many lock-free readers and one writer at a time.
+// Readers only follow atomic child links under an epoch pin. The writer
+// publishes every change with a single release store and hands unlinked
+// nodes to the epoch domain, which frees them once no reader can hold them.
+
+template <class T>
+struct RcuNode
+{
+	T value;
+	std::atomic<RcuNode*> left{ nullptr };
+	std::atomic<RcuNode*> right{ nullptr };
+	template <class U>
+	RcuNode(U&& x)
+		: value(std::forward<U>(x)) {}
+};
+
+template <class T>
+class RcuTree
+{
+private:
+	using node_ptr = RcuNode<T>*;
+	std::atomic<node_ptr> root{ nullptr };
+	std::atomic<int> size_{ 0 };
+	std::mutex writerLock;
+
+	static node_ptr load_(const std::atomic<node_ptr>& link)
+	{
+		return link.load(std::memory_order_acquire);
+	}
+
+	void clear_(node_ptr node)
+	{
+		std::vector<node_ptr> pending;
+		if (node)
+			pending.push_back(node);
+		while (!pending.empty())
+		{
+			node = pending.back();
+			pending.pop_back();
+			if (node_ptr left = node->left.load(std::memory_order_relaxed))
+				pending.push_back(left);
+			if (node_ptr right = node->right.load(std::memory_order_relaxed))
+				pending.push_back(right);
+			delete node;
+		}
+	}
+
+public:
+	RcuTree() = default;
+	RcuTree(const RcuTree&) = delete;
+	RcuTree& operator=(const RcuTree&) = delete;
+
+	// Requires that no reader or writer is still using the tree.
+	~RcuTree()
+	{
+		this->clear_(root.load(std::memory_order_relaxed));
+	}
+
+	template <class U>
+	void insert(U&& x)
+	{
+		std::lock_guard<std::mutex> lock(writerLock);
+		node_ptr node = new RcuNode<T>(std::forward<U>(x));
+		std::atomic<node_ptr>* link = &root;
+		while (node_ptr current = link->load(std::memory_order_relaxed))
+			link = node->value < current->value ? &current->left : &current->right;
+		link->store(node, std::memory_order_release);
+		size_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Removes one occurrence of x. A node with two children is replaced by a
+	// fresh copy holding its successor's value. A reader already below the
+	// old node may still be heading for the successor, so the successor is
+	// unlinked only after a grace period (as in Citrus); a concurrent reader
+	// therefore always finds every key that stays. Such removals wait for
+	// every pinned reader and hold up other writers meanwhile, so remove
+	// must not be called while pinned.
+	bool remove(const T& x)
+	{
+		std::lock_guard<std::mutex> lock(writerLock);
+		std::atomic<node_ptr>* link = &root;
+		node_ptr node = link->load(std::memory_order_relaxed);
+		while (node != nullptr && !(node->value == x))
+		{
+			link = x < node->value ? &node->left : &node->right;
+			node = link->load(std::memory_order_relaxed);
+		}
+		if (node == nullptr)
+			return false;
+
+		node_ptr left = node->left.load(std::memory_order_relaxed);
+		node_ptr right = node->right.load(std::memory_order_relaxed);
+		if (left == nullptr || right == nullptr)
+		{
+			link->store(left ? left : right, std::memory_order_release);
+			epoch::retire(node);
+		}
+		else
+		{
+			std::atomic<node_ptr>* successorLink = &node->right;
+			node_ptr successor = right;
+			while (node_ptr next = successor->left.load(std::memory_order_relaxed))
+			{
+				successorLink = &successor->left;
+				successor = next;
+			}
+
+			node_ptr copy = new RcuNode<T>(successor->value);
+			copy->left.store(left, std::memory_order_relaxed);
+			copy->right.store(right, std::memory_order_relaxed);
+			link->store(copy, std::memory_order_release);
+			epoch::waitForReaders();
+
+			if (successorLink == &node->right)
+				successorLink = &copy->right;
+			successorLink->store(successor->right.load(std::memory_order_relaxed), std::memory_order_release);
+
+			epoch::retire(node);
+			epoch::retire(successor);
+		}
+		size_.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Keeps the calling thread pinned; pointers returned by search stay
+	// valid until the guard is destroyed.
+	epoch::Domain::Guard pin() const
+	{
+		return epoch::pin();
+	}
+
+	// Must be called while pinned.
+	const T* search(const T& x) const
+	{
+		node_ptr current = load_(root);
+		while (current != nullptr && !(current->value == x))
+			current = load_(x < current->value ? current->left : current->right);
+		return current ? &current->value : nullptr;
+	}
+
+	bool contains(const T& x) const
+	{
+		auto guard = epoch::pin();
+		return this->search(x) != nullptr;
+	}
+
+	// In-order walk without locks. Keys present for the whole walk are all
+	// visited; keys inserted or removed meanwhile may or may not be, and a
+	// successor moved by a concurrent removal can show up twice.
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<node_ptr> path;
+		node_ptr node = load_(root);
+		while (node != nullptr || !path.empty())
+		{
+			while (node != nullptr)
+			{
+				path.push_back(node);
+				node = load_(node->left);
+			}
+			node = path.back();
+			path.pop_back();
+			visit(std::as_const(node->value));
+			node = load_(node->right);
+		}
+	}
+
+	// Visits the values in [low, high] in order, with the same guarantees as
+	// visitInorder. Subtrees wholly outside the range are not entered.
+	template <class F>
+	void visitRange(const T& low, const T& high, F&& visit) const
+	{
+		auto guard = epoch::pin();
+		std::vector<node_ptr> path;
+		node_ptr node = load_(root);
+		while (node != nullptr || !path.empty())
+		{
+			while (node != nullptr)
+			{
+				if (node->value < low)
+					node = load_(node->right);
+				else
+				{
+					path.push_back(node);
+					node = load_(node->left);
+				}
+			}
+			if (path.empty())
+				return;
+			node = path.back();
+			path.pop_back();
+			if (high < node->value)
+				return;
+			visit(std::as_const(node->value));
+			node = load_(node->right);
+		}
+	}
+
+	int size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	// Levels on the longest root-to-leaf path, in the tree as published when
+	// the walk reaches each node.
+	int depth() const
+	{
+		auto guard = epoch::pin();
+		int result = 0;
+		std::vector<std::pair<node_ptr, int>> pending;
+		if (node_ptr top = load_(root))
+			pending.push_back({ top, 1 });
+		while (!pending.empty())
+		{
+			auto [node, level] = pending.back();
+			pending.pop_back();
+			result = std::max(result, level);
+			if (node_ptr left = load_(node->left))
+				pending.push_back({ left, level + 1 });
+			if (node_ptr right = load_(node->right))
+				pending.push_back({ right, level + 1 });
+		}
+		return result;
+	}
+};
+
+#endif // !RCU_TREE
@@ -0,0 +1,78 @@
+// Mateusz Kawa
+
+#ifndef SHAPE_STATS
+#define SHAPE_STATS
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Shape of a binary tree, gathered in one pass. Depths count nodes, so the
+// root is at depth 1 and height matches depth() of the trees.
+
+struct ShapeStats
+{
+	std::size_t nodes = 0;
+	std::size_t leaves = 0;
+	// Sum of the depths of all nodes (the internal path length plus nodes).
+	std::uint64_t totalDepth = 0;
+	// Nodes per level, root level first; its size is the height.
+	std::vector<std::size_t> levels;
+
+	void addNode(int level, bool leaf)
+	{
+		if (std::size_t(level) >= levels.size())
+			levels.resize(std::size_t(level) + 1, 0);
+		++levels[std::size_t(level)];
+		++nodes;
+		leaves += leaf ? 1 : 0;
+		totalDepth += std::uint64_t(level) + 1;
+	}
+
+	// Adds the shape of a subtree whose root sits offset levels down.
+	void merge(const ShapeStats& other, int offset)
+	{
+		if (other.levels.size() + std::size_t(offset) > levels.size())
+			levels.resize(other.levels.size() + std::size_t(offset), 0);
+		for (std::size_t level = 0; level < other.levels.size(); ++level)
+			levels[level + std::size_t(offset)] += other.levels[level];
+		nodes += other.nodes;
+		leaves += other.leaves;
+		totalDepth += other.totalDepth + std::uint64_t(offset) * other.nodes;
+	}
+
+	int height() const
+	{
+		return int(levels.size());
+	}
+
+	double averageDepth() const
+	{
+		return nodes == 0 ? 0.0 : double(totalDepth) / double(nodes);
+	}
+
+	// Share of the 2^level slots of a level that hold a node.
+	double fillRatio(int level) const
+	{
+		if (level < 0 || std::size_t(level) >= levels.size())
+			return 0.0;
+		return double(levels[std::size_t(level)]) / std::ldexp(1.0, level);
+	}
+
+	// Smallest possible height for this many nodes, ceil(log2(n + 1)).
+	int optimalHeight() const
+	{
+		return int(std::bit_width(nodes));
+	}
+
+	// Height over the optimal height: 1 for a complete tree, n / log2 n for
+	// a linked list.
+	double degeneracy() const
+	{
+		return nodes == 0 ? 1.0 : double(this->height()) / double(this->optimalHeight());
+	}
+};
+
+#endif // !SHAPE_STATS
@@ -0,0 +1,270 @@
+// Mateusz Kawa
+
+#ifndef SHARDED_TREE
+#define SHARDED_TREE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BinaryTree.h"
+
+// Range-partitioned tree. Shard i holds the keys in [bounds[i - 1],
+// bounds[i]), each in its own BinaryTree with its own lock and node arena,
+// so threads working on different key ranges never share a lock or a cache
+// line of tree nodes. The router is an immutable snapshot of the boundaries;
+// an operation routes without locking, locks the shard and re-checks the
+// shard's range, retrying if a rebalance moved the boundary meanwhile.
+//
+// rebalance() moves the boundary between the hottest shard and its cooler
+// neighbour so that their recent load evens out. It can run inline or from
+// the background thread started by startRebalancer().
+
+template <class T>
+class ShardedTree
+{
+public:
+	// A shard is hot once it took this many times its fair share of the
+	// operations since the last rebalance.
+	static constexpr double HOT_RATIO = 2.0;
+
+private:
+	using Bounds = std::vector<T>;
+
+	struct Shard
+	{
+		std::mutex lock;
+		BinaryTree<T> tree;
+		std::atomic<std::uint64_t> hits{ 0 };
+		std::optional<T> low;
+		std::optional<T> high;
+
+		bool owns(const T& x) const
+		{
+			return (!low || !(x < *low)) && (!high || x < *high);
+		}
+	};
+
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::atomic<std::shared_ptr<const Bounds>> bounds;
+	std::atomic<int> size_{ 0 };
+
+	// Shared by ordered walks, exclusive while keys move between shards.
+	mutable std::shared_mutex layoutLock;
+
+	std::thread rebalancer;
+	std::mutex rebalancerLock;
+	std::condition_variable rebalancerWake;
+	bool rebalancerStop = false;
+
+	// Returns the shard owning x, locked.
+	std::pair<Shard*, std::unique_lock<std::mutex>> route_(const T& x) const
+	{
+		while (true)
+		{
+			std::shared_ptr<const Bounds> snapshot = bounds.load(std::memory_order_acquire);
+			std::size_t index = std::upper_bound(snapshot->begin(), snapshot->end(), x) - snapshot->begin();
+			Shard* shard = shards[index].get();
+			std::unique_lock<std::mutex> lock(shard->lock);
+			if (shard->owns(x))
+			{
+				shard->hits.fetch_add(1, std::memory_order_relaxed);
+				return { shard, std::move(lock) };
+			}
+		}
+	}
+
+	// Walks the merged keys of two neighbouring shards, weighting each key by
+	// its shard's hits per key, and returns the first index past half of the
+	// total weight that does not split a run of equal keys.
+	static std::size_t splitPoint_(const std::vector<T>& keys, std::size_t leftCount, double leftWeight, double rightWeight)
+	{
+		double total = leftWeight * leftCount + rightWeight * (keys.size() - leftCount);
+		double accumulated = 0.0;
+		std::size_t split = 0;
+		while (split < keys.size() && accumulated < total / 2)
+		{
+			accumulated += split < leftCount ? leftWeight : rightWeight;
+			++split;
+		}
+		while (split > 0 && split < keys.size() && !(keys[split - 1] < keys[split]))
+			++split;
+		return split;
+	}
+
+	void rebalancerLoop_(std::chrono::milliseconds interval)
+	{
+		std::unique_lock<std::mutex> lock(rebalancerLock);
+		while (!rebalancerWake.wait_for(lock, interval, [this] { return rebalancerStop; }))
+		{
+			lock.unlock();
+			this->rebalance();
+			lock.lock();
+		}
+	}
+
+public:
+	// boundaries must be sorted; n boundaries make n + 1 shards.
+	explicit ShardedTree(std::vector<T> boundaries)
+	{
+		shards.reserve(boundaries.size() + 1);
+		for (std::size_t i = 0; i <= boundaries.size(); ++i)
+		{
+			auto shard = std::make_unique<Shard>();
+			if (i > 0)
+				shard->low = boundaries[i - 1];
+			if (i < boundaries.size())
+				shard->high = boundaries[i];
+			shards.push_back(std::move(shard));
+		}
+		bounds.store(std::make_shared<const Bounds>(std::move(boundaries)));
+	}
+
+	ShardedTree(const ShardedTree&) = delete;
+	ShardedTree& operator=(const ShardedTree&) = delete;
+
+	~ShardedTree()
+	{
+		this->stopRebalancer();
+	}
+
+	template <class U>
+	void insert(U&& x)
+	{
+		auto [shard, lock] = this->route_(x);
+		shard->tree.insert(std::forward<U>(x));
+		size_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Removes one occurrence of x.
+	bool remove(const T& x)
+	{
+		auto [shard, lock] = this->route_(x);
+		if (!shard->tree.remove(x))
+			return false;
+		size_.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool contains(const T& x) const
+	{
+		auto [shard, lock] = this->route_(x);
+		return shard->tree.search(x) != nullptr;
+	}
+
+	int size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	std::size_t shardCount() const
+	{
+		return shards.size();
+	}
+
+	int shardSize(std::size_t index) const
+	{
+		std::lock_guard<std::mutex> lock(shards[index]->lock);
+		return shards[index]->tree.size();
+	}
+
+	// Ordered walk over all shards. Each shard is visited under its own lock
+	// and no boundary moves during the walk, so every key that is present
+	// throughout is visited exactly once and in order.
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		std::shared_lock<std::shared_mutex> layout(layoutLock);
+		for (const auto& shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard->lock);
+			shard->tree.visitInorder(visit);
+		}
+	}
+
+	// Moves the boundary between the hottest shard and its cooler neighbour.
+	// Returns false when no shard is hot or the keys cannot be split any
+	// better. Hit counters are halved afterwards so old load fades out.
+	bool rebalance()
+	{
+		std::unique_lock<std::shared_mutex> layout(layoutLock);
+		if (shards.size() < 2)
+			return false;
+
+		std::vector<std::uint64_t> hits(shards.size());
+		std::uint64_t total = 0;
+		for (std::size_t i = 0; i < shards.size(); ++i)
+			total += hits[i] = shards[i]->hits.load(std::memory_order_relaxed);
+		for (const auto& shard : shards)
+			shard->hits.store(shard->hits.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+
+		std::size_t hot = std::max_element(hits.begin(), hits.end()) - hits.begin();
+		if (total == 0 || hits[hot] * double(shards.size()) < HOT_RATIO * total)
+			return false;
+		std::size_t cool;
+		if (hot == 0)
+			cool = 1;
+		else if (hot + 1 == shards.size())
+			cool = hot - 1;
+		else
+			cool = hits[hot - 1] <= hits[hot + 1] ? hot - 1 : hot + 1;
+
+		std::size_t leftIndex = std::min(hot, cool);
+		Shard& left = *shards[leftIndex];
+		Shard& right = *shards[leftIndex + 1];
+		std::scoped_lock locks(left.lock, right.lock);
+
+		std::vector<T> keys;
+		keys.reserve(std::size_t(left.tree.size()) + std::size_t(right.tree.size()));
+		left.tree.visitInorder([&](const T& x) { keys.push_back(x); });
+		std::size_t leftCount = keys.size();
+		right.tree.visitInorder([&](const T& x) { keys.push_back(x); });
+
+		double leftWeight = leftCount ? double(hits[leftIndex]) / leftCount : 0.0;
+		double rightWeight = keys.size() > leftCount ? double(hits[leftIndex + 1]) / (keys.size() - leftCount) : 0.0;
+		std::size_t split = splitPoint_(keys, leftCount, leftWeight, rightWeight);
+		if (split == 0 || split == keys.size() || split == leftCount)
+			return false;
+
+		left.tree.buildFromSorted(keys.begin(), keys.begin() + split);
+		right.tree.buildFromSorted(keys.begin() + split, keys.end());
+		left.high = keys[split];
+		right.low = keys[split];
+
+		auto next = std::make_shared<Bounds>(*bounds.load(std::memory_order_relaxed));
+		(*next)[leftIndex] = keys[split];
+		bounds.store(std::move(next), std::memory_order_release);
+		return true;
+	}
+
+	void startRebalancer(std::chrono::milliseconds interval)
+	{
+		this->stopRebalancer();
+		rebalancerStop = false;
+		rebalancer = std::thread([this, interval] { this->rebalancerLoop_(interval); });
+	}
+
+	void stopRebalancer()
+	{
+		if (!rebalancer.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(rebalancerLock);
+			rebalancerStop = true;
+		}
+		rebalancerWake.notify_all();
+		rebalancer.join();
+	}
+};
+
+#endif // !SHARDED_TREE
@@ -0,0 +1,261 @@
+// Mateusz Kawa
+
+#ifndef STRING_TREE
+#define STRING_TREE
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "NodeArena.h"
+#include "TreeWalk.h"
+
+// Binary search tree specialised for string keys. Key bytes are copied once
+// into a byte arena and every node carries the first eight bytes of its key
+// as a big-endian integer, so most comparisons are a single integer compare
+// that never touches the key bytes. Only keys sharing the whole prefix fall
+// back to memcmp on the rest. Equal keys inserted again share one copy of
+// the bytes.
+
+// Append-only storage for key bytes, carved out of large chunks.
+class KeyArena
+{
+private:
+	static constexpr std::size_t CHUNK_BYTES = 1 << 16;
+
+	std::vector<std::unique_ptr<char[]>> chunks;
+	std::size_t used = CHUNK_BYTES;
+	std::size_t bytes = 0;
+
+public:
+	const char* intern(std::string_view key)
+	{
+		// Nothing to copy, and there may be no chunk to point into yet.
+		if (key.empty())
+			return "";
+		bytes += key.size();
+		if (key.size() > CHUNK_BYTES / 4)
+		{
+			// Large keys get a chunk of their own, placed before the current
+			// one so that small keys keep filling it.
+			auto position = chunks.empty() ? chunks.end() : chunks.end() - 1;
+			char* copy = chunks.emplace(position, new char[key.size()])->get();
+			std::memcpy(copy, key.data(), key.size());
+			return copy;
+		}
+		if (CHUNK_BYTES - used < key.size())
+		{
+			chunks.emplace_back(new char[CHUNK_BYTES]);
+			used = 0;
+		}
+		char* copy = chunks.back().get() + used;
+		std::memcpy(copy, key.data(), key.size());
+		used += key.size();
+		return copy;
+	}
+
+	void clear()
+	{
+		chunks.clear();
+		used = CHUNK_BYTES;
+		bytes = 0;
+	}
+
+	std::size_t storedBytes() const { return bytes; }
+	std::size_t chunkCount() const { return chunks.size(); }
+};
+
+struct StringNode
+{
+	std::uint64_t prefix;
+	const char* bytes;
+	std::uint32_t length;
+	StringNode* right;
+	StringNode* left;
+	StringNode* parent;
+	StringNode(std::uint64_t prefix, const char* bytes, std::uint32_t length)
+		: prefix(prefix), bytes(bytes), length(length), right(nullptr), left(nullptr), parent(nullptr) {}
+
+	std::string_view key() const { return std::string_view(bytes, length); }
+};
+
+class StringTree
+{
+public:
+	using node_ptr = StringNode*;
+
+private:
+	node_ptr root = nullptr;
+	int size_ = 0;
+	NodeArena<StringNode> arena;
+	KeyArena keys;
+
+	// A probe key with its prefix computed once per operation.
+	struct Probe
+	{
+		std::uint64_t prefix;
+		std::string_view key;
+	};
+
+	// First eight bytes, zero padded, so that integer order is byte order.
+	static std::uint64_t prefixOf_(std::string_view key)
+	{
+		std::uint64_t prefix = 0;
+		std::size_t n = std::min<std::size_t>(key.size(), 8);
+		for (std::size_t i = 0; i < n; ++i)
+			prefix |= std::uint64_t(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+		return prefix;
+	}
+
+	// Three-way comparison of probe against node; the prefixes decide unless
+	// they are equal.
+	static int compare_(const Probe& probe, const StringNode* node)
+	{
+		if (probe.prefix != node->prefix)
+			return probe.prefix < node->prefix ? -1 : 1;
+		std::size_t shorter = std::min<std::size_t>(probe.key.size(), node->length);
+		if (shorter > 8)
+		{
+			int order = std::memcmp(probe.key.data() + 8, node->bytes + 8, shorter - 8);
+			if (order != 0)
+				return order;
+		}
+		if (probe.key.size() == node->length)
+			return 0;
+		return probe.key.size() < node->length ? -1 : 1;
+	}
+
+	int depth_(node_ptr node) const
+	{
+		if (node == nullptr)
+			return 0;
+		return std::max(this->depth_(node->left), this->depth_(node->right)) + 1;
+	}
+
+public:
+	StringTree() = default;
+	StringTree(const StringTree&) = delete;
+	StringTree& operator=(const StringTree&) = delete;
+
+	struct Iterator
+	{
+		node_ptr current;
+		Iterator(node_ptr node)
+			: current(node ? walkLeftmost(node) : nullptr) {}
+
+		std::string_view operator*() const { return current->key(); }
+		Iterator& operator++()
+		{
+			if (current->right)
+				current = walkLeftmost(current->right);
+			else
+			{
+				node_ptr parent = current->parent;
+				while (parent != nullptr && current == parent->right)
+				{
+					current = parent;
+					parent = parent->parent;
+				}
+				current = parent;
+			}
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const { return current == other.current; }
+		bool operator!=(const Iterator& other) const { return current != other.current; }
+	};
+
+	// Equal keys go right, as in BinaryTree.
+	void insert(std::string_view key)
+	{
+		Probe probe{ prefixOf_(key), key };
+		node_ptr parent = nullptr;
+		node_ptr node = root;
+		const char* bytes = nullptr;
+		bool left = false;
+		while (node != nullptr)
+		{
+			int order = compare_(probe, node);
+			if (order == 0)
+				bytes = node->bytes;
+			parent = node;
+			left = order < 0;
+			node = left ? node->left : node->right;
+		}
+		if (bytes == nullptr)
+			bytes = keys.intern(key);
+		node = arena.create(probe.prefix, bytes, std::uint32_t(key.size()));
+		node->parent = parent;
+		if (parent == nullptr)
+			root = node;
+		else if (left)
+			parent->left = node;
+		else
+			parent->right = node;
+		++size_;
+	}
+
+	node_ptr search(std::string_view key) const
+	{
+		Probe probe{ prefixOf_(key), key };
+		node_ptr node = root;
+		while (node != nullptr)
+		{
+			int order = compare_(probe, node);
+			if (order == 0)
+				return node;
+			node = order < 0 ? node->left : node->right;
+		}
+		return nullptr;
+	}
+
+	bool contains(std::string_view key) const
+	{
+		return this->search(key) != nullptr;
+	}
+
+	int size() const
+	{
+		return size_;
+	}
+
+	int depth() const
+	{
+		return this->depth_(root);
+	}
+
+	template <class F>
+	void visitInorder(F&& visit) const
+	{
+		walkInorder(root, [&](node_ptr node) { visit(node->key()); });
+	}
+
+	void clear()
+	{
+		arena.releaseAll();
+		keys.clear();
+		root = nullptr;
+		size_ = 0;
+	}
+
+	// Bytes copied into the key arena; repeated keys are not counted again.
+	std::size_t keyBytes() const
+	{
+		return keys.storedBytes();
+	}
+
+	node_ptr getRoot()
+	{
+		return root;
+	}
+
+	Iterator begin() const { return Iterator(root); }
+	Iterator end() const { return Iterator(nullptr); }
+};
+
+#endif // !STRING_TREE
@@ -0,0 +1,247 @@
+// Mateusz Kawa
+
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing thread pool for fork/join over trees. Every worker owns a
+// deque: it pushes and pops its own tasks at the back, so recursive splits
+// run depth first and stay cache-warm, while idle workers steal from the
+// front, where the largest pieces of work sit.
+
+namespace tasks
+{
+	class ThreadPool
+	{
+	public:
+		using Task = std::function<void()>;
+		static constexpr std::size_t NOT_A_WORKER = static_cast<std::size_t>(-1);
+
+	private:
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+		std::atomic<std::size_t> queued{ 0 };
+		std::atomic<std::size_t> nextVictim{ 0 };
+		std::mutex sleepLock;
+		std::condition_variable wake;
+		bool stopping = false;
+
+		static inline thread_local ThreadPool* currentPool = nullptr;
+		static inline thread_local std::size_t currentIndex = NOT_A_WORKER;
+
+		bool popOwn_(std::size_t index, Task& task)
+		{
+			Worker& worker = *workers[index];
+			std::lock_guard<std::mutex> lock(worker.lock);
+			if (worker.tasks.empty())
+				return false;
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			return true;
+		}
+
+		bool steal_(std::size_t thief, Task& task)
+		{
+			for (std::size_t i = 1; i < workers.size(); ++i)
+			{
+				Worker& victim = *workers[(thief + i) % workers.size()];
+				std::lock_guard<std::mutex> lock(victim.lock);
+				if (victim.tasks.empty())
+					continue;
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+			return false;
+		}
+
+		void workerLoop_(std::size_t index)
+		{
+			currentPool = this;
+			currentIndex = index;
+			while (true)
+			{
+				if (this->runOne())
+					continue;
+				std::unique_lock<std::mutex> lock(sleepLock);
+				wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+				if (stopping)
+					return;
+			}
+		}
+
+	public:
+		explicit ThreadPool(std::size_t threadCount = std::max(1u, std::thread::hardware_concurrency()))
+		{
+			threadCount = std::max<std::size_t>(threadCount, 1);
+			for (std::size_t i = 0; i < threadCount; ++i)
+				workers.push_back(std::make_unique<Worker>());
+			for (std::size_t i = 0; i < threadCount; ++i)
+				threads.emplace_back([this, i] { this->workerLoop_(i); });
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Every task group using the pool must have been waited on.
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepLock);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		// Process-wide pool with one worker per hardware thread.
+		static ThreadPool& shared()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		std::size_t threadCount() const
+		{
+			return workers.size();
+		}
+
+		// Index of the calling worker in [0, threadCount()), or NOT_A_WORKER
+		// when called from a thread outside this pool.
+		std::size_t workerIndex() const
+		{
+			return currentPool == this ? currentIndex : NOT_A_WORKER;
+		}
+
+		// Workers queue on their own deque; outside threads spread their
+		// tasks round-robin.
+		void submit(Task task)
+		{
+			std::size_t index = this->workerIndex();
+			if (index == NOT_A_WORKER)
+				index = nextVictim.fetch_add(1, std::memory_order_relaxed) % workers.size();
+			{
+				std::lock_guard<std::mutex> lock(workers[index]->lock);
+				workers[index]->tasks.push_back(std::move(task));
+			}
+			queued.fetch_add(1, std::memory_order_release);
+			{
+				std::lock_guard<std::mutex> lock(sleepLock);
+			}
+			wake.notify_one();
+		}
+
+		// Runs one queued task on the calling worker. Returns false when there
+		// was nothing to run or the caller is not a worker of this pool.
+		bool runOne()
+		{
+			std::size_t index = this->workerIndex();
+			if (index == NOT_A_WORKER)
+				return false;
+			Task task;
+			if (!this->popOwn_(index, task) && !this->steal_(index, task))
+				return false;
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			task();
+			return true;
+		}
+	};
+
+	// Fork/join scope. wait() on a worker keeps running queued tasks until
+	// the group is done, so nested groups never block a worker; any other
+	// thread just sleeps. The first exception thrown by a task is rethrown
+	// from wait().
+	class TaskGroup
+	{
+	private:
+		ThreadPool& pool;
+		std::atomic<std::size_t> outstanding{ 0 };
+		std::mutex lock;
+		std::condition_variable done;
+		std::exception_ptr error;
+
+		// Completion is signalled under the lock, so once a waiter has taken
+		// the lock after seeing zero, no task touches the group any more.
+		void finish_(std::exception_ptr failure)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (failure && !error)
+				error = failure;
+			if (outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				done.notify_all();
+		}
+
+		void waitQuietly_()
+		{
+			if (pool.workerIndex() != ThreadPool::NOT_A_WORKER)
+				while (outstanding.load(std::memory_order_acquire) != 0)
+					if (!pool.runOne())
+						std::this_thread::yield();
+			std::unique_lock<std::mutex> guard(lock);
+			done.wait(guard, [this] { return outstanding.load(std::memory_order_acquire) == 0; });
+		}
+
+	public:
+		explicit TaskGroup(ThreadPool& pool)
+			: pool(pool) {}
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		~TaskGroup()
+		{
+			this->waitQuietly_();
+		}
+
+		template <class F>
+		void run(F&& f)
+		{
+			outstanding.fetch_add(1, std::memory_order_relaxed);
+			pool.submit([this, f = std::forward<F>(f)]() mutable {
+				std::exception_ptr failure;
+				try
+				{
+					f();
+				}
+				catch (...)
+				{
+					failure = std::current_exception();
+				}
+				this->finish_(failure);
+			});
+		}
+
+		void wait()
+		{
+			this->waitQuietly_();
+			if (error)
+				std::rethrow_exception(std::exchange(error, nullptr));
+		}
+
+		ThreadPool& getPool()
+		{
+			return pool;
+		}
+	};
+}
+
+#endif // !THREAD_POOL
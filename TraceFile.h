@@ -0,0 +1,401 @@
+// Mateusz Kawa
+
+#ifndef TRACE_FILE
+#define TRACE_FILE
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "TreeFile.h"
+
+// Workload traces: the operations a tree served, in order, so they can be
+// replayed offline against any engine. The binary form follows TreeFile.h:
+//
+//   header   "BSTR", u16 version, u8 encoding, u8 key bytes, u64 op count
+//   payload  per op a u8 kind, then its key (a range stores low and high)
+//   trailer  u64 payload bytes, u32 CRC-32 of the payload
+//
+// Integer keys are stored as zig-zag varints of the difference from the
+// previous key in the trace, floating-point keys as their raw bits and
+// strings as a varint length followed by the bytes. The text form has one
+// op per line, "insert 42", "search 42", "erase 42" or "range 10 20" (or
+// just the first letter), with '#' starting a comment.
+
+namespace tracefile
+{
+	constexpr char MAGIC[4] = { 'B', 'S', 'T', 'R' };
+	constexpr std::uint16_t VERSION = 2;
+
+	enum class OpKind : std::uint8_t { Insert = 1, Search = 2, Erase = 3, Range = 4 };
+
+	constexpr std::size_t OP_KINDS = 4;
+
+	inline std::size_t kindIndex(OpKind kind)
+	{
+		return std::size_t(kind) - 1;
+	}
+
+	inline const char* kindName(OpKind kind)
+	{
+		switch (kind)
+		{
+		case OpKind::Insert: return "insert";
+		case OpKind::Search: return "search";
+		case OpKind::Erase: return "erase";
+		case OpKind::Range: return "range";
+		}
+		return "";
+	}
+
+	template <class T>
+	struct Op
+	{
+		OpKind kind;
+		T key;
+		// Upper end of a range, inclusive; unused by the other kinds.
+		T high{};
+	};
+
+	// Streams ops to a binary trace as they happen, e.g. from a wrapper
+	// around a production tree. The op count is patched into the header by
+	// finish().
+	template <class T>
+	class Recorder
+	{
+	private:
+		static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+		static constexpr std::size_t MAX_RECORD = 1 + 2 * 10;
+
+		treefile::FilePtr file;
+		treefile::Crc32 crc;
+		std::uint64_t count = 0;
+		std::uint64_t written = 0;
+		std::uint64_t previous = 0;
+		bool ok = false;
+		std::size_t used = 0;
+		std::unique_ptr<unsigned char[]> buffer;
+
+		void reserve_(std::size_t bytes)
+		{
+			if (BUFFER_SIZE - used < bytes)
+				this->flush_();
+		}
+
+		void varint_(std::uint64_t value)
+		{
+			this->reserve_(10);
+			while (value >= 0x80)
+			{
+				buffer[used++] = static_cast<unsigned char>(value | 0x80);
+				value >>= 7;
+			}
+			buffer[used++] = static_cast<unsigned char>(value);
+		}
+
+		void bytes_(const void* data, std::size_t length)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			while (length != 0)
+			{
+				if (used == BUFFER_SIZE)
+					this->flush_();
+				std::size_t chunk = std::min(length, BUFFER_SIZE - used);
+				std::memcpy(buffer.get() + used, bytes, chunk);
+				used += chunk;
+				bytes += chunk;
+				length -= chunk;
+			}
+		}
+
+		void key_(const T& x)
+		{
+			if constexpr (std::is_integral_v<T>)
+			{
+				std::uint64_t ordered = treefile::toOrdered(x);
+				std::uint64_t delta = ordered - previous;
+				// Zig-zag: small steps either way make short varints.
+				this->varint_((delta << 1) ^ (0 - (delta >> 63)));
+				previous = ordered;
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+				Bits bits = std::bit_cast<Bits>(x);
+				this->reserve_(sizeof(Bits));
+				for (std::size_t i = 0; i < sizeof(Bits); ++i)
+					buffer[used++] = static_cast<unsigned char>(bits >> (8 * i));
+			}
+			else
+			{
+				this->varint_(x.size());
+				this->bytes_(x.data(), x.size());
+			}
+		}
+
+		void flush_()
+		{
+			if (used == 0)
+				return;
+			crc.update(buffer.get(), used);
+			ok = ok && std::fwrite(buffer.get(), 1, used, file.get()) == used;
+			written += used;
+			used = 0;
+		}
+
+	public:
+		explicit Recorder(const std::string& path)
+			: file(treefile::open(path, "wb")), buffer(new unsigned char[BUFFER_SIZE])
+		{
+			if (!file)
+				return;
+			unsigned char header[treefile::HEADER_BYTES] = {};
+			std::memcpy(header, MAGIC, 4);
+			header[4] = static_cast<unsigned char>(VERSION);
+			header[5] = static_cast<unsigned char>(VERSION >> 8);
+			header[6] = static_cast<unsigned char>(treefile::encodingOf<T>());
+			header[7] = treefile::keyBytesOf<T>();
+			ok = std::fwrite(header, 1, treefile::HEADER_BYTES, file.get()) == treefile::HEADER_BYTES;
+		}
+
+		Recorder(const Recorder&) = delete;
+		Recorder& operator=(const Recorder&) = delete;
+
+		bool good() const
+		{
+			return ok;
+		}
+
+		void record(const Op<T>& op)
+		{
+			this->reserve_(MAX_RECORD);
+			buffer[used++] = static_cast<unsigned char>(op.kind);
+			this->key_(op.key);
+			if (op.kind == OpKind::Range)
+				this->key_(op.high);
+			++count;
+		}
+
+		void insert(const T& x) { this->record({ OpKind::Insert, x }); }
+		void search(const T& x) { this->record({ OpKind::Search, x }); }
+		void erase(const T& x) { this->record({ OpKind::Erase, x }); }
+		void range(const T& low, const T& high) { this->record({ OpKind::Range, low, high }); }
+
+		// Writes the trailer and the op count. The recorder is done after it.
+		bool finish()
+		{
+			if (!file)
+				return false;
+			this->flush_();
+			unsigned char trailer[treefile::TRAILER_BYTES];
+			for (std::size_t i = 0; i < 8; ++i)
+				trailer[i] = static_cast<unsigned char>(written >> (8 * i));
+			std::uint32_t checksum = crc.value();
+			for (std::size_t i = 0; i < 4; ++i)
+				trailer[8 + i] = static_cast<unsigned char>(checksum >> (8 * i));
+			ok = ok && std::fwrite(trailer, 1, treefile::TRAILER_BYTES, file.get()) == treefile::TRAILER_BYTES;
+
+			unsigned char countBytes[8];
+			for (std::size_t i = 0; i < 8; ++i)
+				countBytes[i] = static_cast<unsigned char>(count >> (8 * i));
+			ok = ok && std::fseek(file.get(), 8, SEEK_SET) == 0
+				&& std::fwrite(countBytes, 1, 8, file.get()) == 8 && std::fflush(file.get()) == 0;
+			file.reset();
+			return ok;
+		}
+	};
+
+	template <class T>
+	bool save(const std::string& path, const std::vector<Op<T>>& ops)
+	{
+		Recorder<T> recorder(path);
+		for (const Op<T>& op : ops)
+			recorder.record(op);
+		return recorder.finish();
+	}
+
+	// Reads a binary trace into ops. Returns false, leaving ops in an
+	// unspecified state, if the file is missing, truncated, of another key
+	// type or fails its checksum.
+	template <class T>
+	bool load(const std::string& path, std::vector<Op<T>>& ops)
+	{
+		std::vector<unsigned char> contents;
+		if (!treefile::readAll(path, contents) || contents.size() < treefile::HEADER_BYTES + treefile::TRAILER_BYTES)
+			return false;
+		const unsigned char* header = contents.data();
+		if (std::memcmp(header, MAGIC, 4) != 0 || treefile::readLittleEndian(header + 4, 2) != VERSION
+			|| header[6] != static_cast<unsigned char>(treefile::encodingOf<T>()) || header[7] != treefile::keyBytesOf<T>())
+			return false;
+		std::uint64_t count = treefile::readLittleEndian(header + 8, 8);
+
+		const unsigned char* payload = header + treefile::HEADER_BYTES;
+		const unsigned char* trailer = contents.data() + contents.size() - treefile::TRAILER_BYTES;
+		std::uint64_t payloadBytes = treefile::readLittleEndian(trailer, 8);
+		if (payloadBytes != std::uint64_t(trailer - payload))
+			return false;
+		treefile::Crc32 crc;
+		crc.update(payload, std::size_t(payloadBytes));
+		if (crc.value() != treefile::readLittleEndian(trailer + 8, 4))
+			return false;
+
+		const unsigned char* cursor = payload;
+		auto varint = [&](std::uint64_t& value) {
+			value = 0;
+			for (int shift = 0; cursor < trailer && shift < 64; shift += 7)
+			{
+				unsigned char byte = *cursor++;
+				value |= std::uint64_t(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return true;
+			}
+			return false;
+		};
+		std::uint64_t previous = 0;
+		auto key = [&](T& x) {
+			if constexpr (std::is_integral_v<T>)
+			{
+				std::uint64_t zigzag;
+				if (!varint(zigzag))
+					return false;
+				previous += (zigzag >> 1) ^ (0 - (zigzag & 1));
+				x = treefile::fromOrdered<T>(previous);
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+				if (std::size_t(trailer - cursor) < sizeof(T))
+					return false;
+				x = std::bit_cast<T>(static_cast<Bits>(treefile::readLittleEndian(cursor, sizeof(T))));
+				cursor += sizeof(T);
+			}
+			else
+			{
+				std::uint64_t length;
+				if (!varint(length) || std::uint64_t(trailer - cursor) < length)
+					return false;
+				x.assign(reinterpret_cast<const char*>(cursor), std::size_t(length));
+				cursor += length;
+			}
+			return true;
+		};
+
+		ops.clear();
+		ops.reserve(std::size_t(std::min<std::uint64_t>(count, payloadBytes / 2)));
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			if (cursor == trailer || *cursor < std::uint8_t(OpKind::Insert) || *cursor > std::uint8_t(OpKind::Range))
+				return false;
+			Op<T> op{ OpKind(*cursor++), T{} };
+			if (!key(op.key) || (op.kind == OpKind::Range && !key(op.high)))
+				return false;
+			ops.push_back(std::move(op));
+		}
+		return cursor == trailer;
+	}
+
+	template <class T>
+	bool parseKey(const std::string& token, T& x)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			// std::from_chars has no bool overload.
+			x = token == "1" || token == "true";
+			return x || token == "0" || token == "false";
+		}
+		else if constexpr (std::is_arithmetic_v<T>)
+		{
+			const char* last = token.data() + token.size();
+			std::from_chars_result result = std::from_chars(token.data(), last, x);
+			return result.ec == std::errc() && result.ptr == last;
+		}
+		else
+		{
+			x = token;
+			return !token.empty();
+		}
+	}
+
+	// Reads the text form. line, when given, receives the number of the
+	// first line that fails to parse.
+	template <class T>
+	bool loadText(const std::string& path, std::vector<Op<T>>& ops, std::size_t* line = nullptr)
+	{
+		std::ifstream in(path);
+		if (!in)
+			return false;
+		ops.clear();
+		std::string text;
+		for (std::size_t number = 1; std::getline(in, text); ++number)
+		{
+			text = text.substr(0, text.find('#'));
+			std::vector<std::string> tokens;
+			for (std::size_t pos = text.find_first_not_of(" \t\r"); pos != std::string::npos;)
+			{
+				std::size_t end = text.find_first_of(" \t\r", pos);
+				tokens.push_back(text.substr(pos, end - pos));
+				pos = end == std::string::npos ? end : text.find_first_not_of(" \t\r", end);
+			}
+			if (tokens.empty())
+				continue;
+
+			Op<T> op{ OpKind::Insert, T{} };
+			const std::string& name = tokens[0];
+			if (name == "insert" || name == "i")
+				op.kind = OpKind::Insert;
+			else if (name == "search" || name == "s")
+				op.kind = OpKind::Search;
+			else if (name == "erase" || name == "e")
+				op.kind = OpKind::Erase;
+			else if (name == "range" || name == "r")
+				op.kind = OpKind::Range;
+			else
+				tokens.clear();
+			std::size_t keys = op.kind == OpKind::Range ? 2 : 1;
+			if (tokens.size() != keys + 1 || !parseKey(tokens[1], op.key) || (keys == 2 && !parseKey(tokens[2], op.high)))
+			{
+				if (line)
+					*line = number;
+				return false;
+			}
+			ops.push_back(std::move(op));
+		}
+		return !in.bad();
+	}
+
+	// Replaces every key by its rank among the distinct keys of the trace.
+	// Order and equality, and with them every tree shape and lookup
+	// outcome, are preserved while the key values themselves are dropped.
+	template <class T>
+	std::vector<Op<std::uint64_t>> anonymize(const std::vector<Op<T>>& ops)
+	{
+		std::vector<T> keys;
+		keys.reserve(ops.size());
+		for (const Op<T>& op : ops)
+		{
+			keys.push_back(op.key);
+			if (op.kind == OpKind::Range)
+				keys.push_back(op.high);
+		}
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+		auto rank = [&](const T& x) { return std::uint64_t(std::lower_bound(keys.begin(), keys.end(), x) - keys.begin()); };
+
+		std::vector<Op<std::uint64_t>> ranked;
+		ranked.reserve(ops.size());
+		for (const Op<T>& op : ops)
+			ranked.push_back({ op.kind, rank(op.key), op.kind == OpKind::Range ? rank(op.high) : 0 });
+		return ranked;
+	}
+}
+
+#endif // !TRACE_FILE
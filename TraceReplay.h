@@ -0,0 +1,245 @@
+// Mateusz Kawa
+
+#ifndef TRACE_REPLAY
+#define TRACE_REPLAY
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ShapeStats.h"
+#include "TraceFile.h"
+
+// Replays a trace against a tree engine, one op at a time in trace order,
+// and reports throughput, latency percentiles and the shape the engine ends
+// up with. Engines are used through whatever they offer: insert(x) is
+// required; lookups go to contains(x) or else search(x); erases to
+// remove(x); ranges to visitRange(low, high, visit). Ops an engine lacks
+// are counted as unsupported and skipped, and the final shape comes from
+// shape_stats(), or from depth() and size() when that is all there is.
+//
+// LockFreeTree is a set; BinaryTree, PersistentTree, RcuTree and
+// OptimisticTree keep duplicate keys. A trace that inserts a key twice and
+// erases it once leaves the multisets holding it, so lookups, erases and
+// ranges, and with them the digest, differ from LockFreeTree from there on.
+// The multisets agree with each other on any trace, and all engines agree
+// on traces without duplicate inserts.
+
+namespace tracereplay
+{
+	using tracefile::Op;
+	using tracefile::OpKind;
+
+	// Outcomes of apply_ other than a hit count: the engine lacks the op, or
+	// ran it without saying what it did (an insert returning void).
+	constexpr std::int64_t UNSUPPORTED = -1;
+	constexpr std::int64_t UNKNOWN = -2;
+
+	struct Latency
+	{
+		std::size_t samples = 0;
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double max = 0.0;
+	};
+
+	// Percentiles in nanoseconds, nearest rank. Sorts nanos.
+	inline Latency summarize(std::vector<float>& nanos)
+	{
+		Latency latency;
+		latency.samples = nanos.size();
+		if (nanos.empty())
+			return latency;
+		std::sort(nanos.begin(), nanos.end());
+		auto rank = [&](double quantile) {
+			std::size_t index = std::size_t(quantile * double(nanos.size()));
+			return double(nanos[std::min(index, nanos.size() - 1)]);
+		};
+		double sum = 0.0;
+		for (float nano : nanos)
+			sum += nano;
+		latency.mean = sum / double(nanos.size());
+		latency.p50 = rank(0.5);
+		latency.p90 = rank(0.9);
+		latency.p99 = rank(0.99);
+		latency.p999 = rank(0.999);
+		latency.max = double(nanos.back());
+		return latency;
+	}
+
+	struct Report
+	{
+		std::size_t ops = 0;
+		double seconds = 0.0;
+		// Per op kind, indexed by tracefile::kindIndex.
+		std::size_t count[tracefile::OP_KINDS] = {};
+		// Inserts that added a key (as far as the engine tells), lookups that
+		// found the key, erases that removed one, and the total number of
+		// values visited by ranges.
+		std::size_t hits[tracefile::OP_KINDS] = {};
+		std::size_t unsupported[tracefile::OP_KINDS] = {};
+		// Inserts into engines that do not say whether the key was new.
+		std::size_t unknown[tracefile::OP_KINDS] = {};
+		Latency latency[tracefile::OP_KINDS];
+		Latency overall;
+		// Median cost of reading the clock twice, included in every sample.
+		double timerOverhead = 0.0;
+		// Hash of the outcome of every lookup, erase and range, in order;
+		// engines that agree on the trace produce the same digest. Inserts
+		// are left out, since not every engine reports theirs, and so are
+		// ops the engine does not support.
+		std::uint64_t digest = 14695981039346656037ull;
+		ShapeStats shape;
+		bool hasShape = false;
+		int size = -1;
+		int depth = -1;
+
+		double opsPerSecond() const
+		{
+			return seconds == 0.0 ? 0.0 : double(ops) / seconds;
+		}
+	};
+
+	struct Options
+	{
+		// Latency is sampled on every sampleEvery-th op; all ops are timed
+		// for throughput.
+		std::size_t sampleEvery = 1;
+	};
+
+	template <class Engine, class T>
+	bool lookup_(Engine& engine, const T& key)
+	{
+		if constexpr (requires { { engine.contains(key) } -> std::convertible_to<bool>; })
+			return engine.contains(key);
+		else
+			return engine.search(key) != nullptr;
+	}
+
+	// Applies op and returns its outcome, UNSUPPORTED or UNKNOWN.
+	template <class Engine, class T>
+	std::int64_t apply_(Engine& engine, const Op<T>& op)
+	{
+		switch (op.kind)
+		{
+		case OpKind::Insert:
+			if constexpr (requires { { engine.insert(op.key) } -> std::convertible_to<bool>; })
+				return engine.insert(op.key) ? 1 : 0;
+			else
+			{
+				engine.insert(op.key);
+				return UNKNOWN;
+			}
+		case OpKind::Search:
+			return lookup_(engine, op.key) ? 1 : 0;
+		case OpKind::Erase:
+			if constexpr (requires { { engine.remove(op.key) } -> std::convertible_to<bool>; })
+				return engine.remove(op.key) ? 1 : 0;
+			else
+				return UNSUPPORTED;
+		case OpKind::Range:
+			if constexpr (requires { engine.visitRange(op.key, op.high, [](const T&) {}); })
+			{
+				std::int64_t visited = 0;
+				engine.visitRange(op.key, op.high, [&](const T&) { ++visited; });
+				return visited;
+			}
+			else
+				return UNSUPPORTED;
+		}
+		return UNSUPPORTED;
+	}
+
+	template <class Engine>
+	void measureShape_(Engine& engine, Report& report)
+	{
+		if constexpr (requires { { engine.shape_stats() } -> std::convertible_to<ShapeStats>; })
+		{
+			report.shape = engine.shape_stats();
+			report.hasShape = true;
+			report.depth = report.shape.height();
+			report.size = int(report.shape.nodes);
+		}
+		else
+		{
+			if constexpr (requires { { engine.depth() } -> std::convertible_to<int>; })
+				report.depth = engine.depth();
+			if constexpr (requires { { engine.size() } -> std::convertible_to<int>; })
+				report.size = int(engine.size());
+		}
+	}
+
+	inline double timerOverhead_()
+	{
+		using Clock = std::chrono::steady_clock;
+		std::vector<float> samples(1000);
+		for (float& sample : samples)
+		{
+			Clock::time_point start = Clock::now();
+			sample = std::chrono::duration<float, std::nano>(Clock::now() - start).count();
+		}
+		return summarize(samples).p50;
+	}
+
+	// Runs ops against engine, which should start out in the state the
+	// trace was captured from (usually empty).
+	template <class Engine, class T>
+	Report replay(Engine& engine, std::span<const Op<T>> ops, const Options& options = {})
+	{
+		using Clock = std::chrono::steady_clock;
+		Report report;
+		report.timerOverhead = timerOverhead_();
+		std::size_t every = std::max<std::size_t>(options.sampleEvery, 1);
+		std::vector<float> samples[tracefile::OP_KINDS];
+		for (std::vector<float>& kind : samples)
+			kind.reserve(ops.size() / every / tracefile::OP_KINDS);
+
+		Clock::time_point begin = Clock::now();
+		for (std::size_t i = 0; i < ops.size(); ++i)
+		{
+			const Op<T>& op = ops[i];
+			std::size_t kind = tracefile::kindIndex(op.kind);
+			std::int64_t outcome;
+			if (i % every == 0)
+			{
+				Clock::time_point start = Clock::now();
+				outcome = apply_(engine, op);
+				float nanos = std::chrono::duration<float, std::nano>(Clock::now() - start).count();
+				if (outcome != UNSUPPORTED)
+					samples[kind].push_back(nanos);
+			}
+			else
+				outcome = apply_(engine, op);
+
+			++report.count[kind];
+			if (outcome == UNSUPPORTED)
+				++report.unsupported[kind];
+			else if (outcome == UNKNOWN)
+				++report.unknown[kind];
+			else if (outcome > 0)
+				report.hits[kind] += std::size_t(outcome);
+			if (op.kind != OpKind::Insert && outcome != UNSUPPORTED)
+				report.digest = (report.digest ^ std::uint64_t(outcome)) * 1099511628211ull;
+		}
+		report.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+		report.ops = ops.size();
+
+		std::vector<float> all;
+		for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+			all.insert(all.end(), samples[kind].begin(), samples[kind].end());
+		for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+			report.latency[kind] = summarize(samples[kind]);
+		report.overall = summarize(all);
+		measureShape_(engine, report);
+		return report;
+	}
+}
+
+#endif // !TRACE_REPLAY
@@ -0,0 +1,370 @@
+// Mateusz Kawa
+
+#ifndef TREE_FILE
+#define TREE_FILE
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary snapshot format for sorted key sequences:
+//
+//   header   "BSTK", u16 version, u8 encoding, u8 key bytes, u64 key count
+//   payload  the keys in order
+//   trailer  u64 payload bytes, u32 CRC-32 of the payload
+//
+// All integers are little endian. Integer keys are stored as varint deltas
+// from the previous key (after flipping the sign bit, so the deltas of a
+// sorted sequence are never negative), floating-point keys as their raw
+// bits and strings as a varint length followed by the bytes. Signed and
+// unsigned integers have encodings of their own, so a file only loads back
+// into a key type of the same size and signedness; bool counts as unsigned.
+
+namespace treefile
+{
+	constexpr char MAGIC[4] = { 'B', 'S', 'T', 'K' };
+	constexpr std::uint16_t VERSION = 2;
+	constexpr std::size_t HEADER_BYTES = 16;
+	constexpr std::size_t TRAILER_BYTES = 12;
+
+	enum class Encoding : std::uint8_t { DeltaVarint = 1, RawBits = 2, LengthPrefixed = 3, SignedDeltaVarint = 4 };
+
+	template <class T>
+	constexpr Encoding encodingOf()
+	{
+		if constexpr (std::is_integral_v<T>)
+			return std::is_signed_v<T> ? Encoding::SignedDeltaVarint : Encoding::DeltaVarint;
+		else if constexpr (std::is_floating_point_v<T>)
+			return Encoding::RawBits;
+		else
+		{
+			static_assert(std::is_same_v<T, std::string>, "keys must be integers, floating point or std::string");
+			return Encoding::LengthPrefixed;
+		}
+	}
+
+	template <class T>
+	constexpr std::uint8_t keyBytesOf()
+	{
+		return std::is_arithmetic_v<T> ? std::uint8_t(sizeof(T)) : 0;
+	}
+
+	constexpr std::array<std::uint32_t, 256> makeCrcTable()
+	{
+		std::array<std::uint32_t, 256> table{};
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			std::uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+			table[i] = crc;
+		}
+		return table;
+	}
+
+	inline constexpr std::array<std::uint32_t, 256> CRC_TABLE = makeCrcTable();
+
+	class Crc32
+	{
+	private:
+		std::uint32_t state = 0xFFFFFFFFu;
+
+	public:
+		void update(const unsigned char* data, std::size_t length)
+		{
+			std::uint32_t crc = state;
+			for (std::size_t i = 0; i < length; ++i)
+				crc = (crc >> 8) ^ CRC_TABLE[(crc ^ data[i]) & 0xFF];
+			state = crc;
+		}
+
+		std::uint32_t value() const
+		{
+			return ~state;
+		}
+	};
+
+	struct FileCloser
+	{
+		void operator()(std::FILE* file) const { std::fclose(file); }
+	};
+
+	using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+	inline FilePtr open(const std::string& path, const char* mode)
+	{
+		std::FILE* file = nullptr;
+#ifdef _MSC_VER
+		if (fopen_s(&file, path.c_str(), mode) != 0)
+			file = nullptr;
+#else
+		file = std::fopen(path.c_str(), mode);
+#endif
+		return FilePtr(file);
+	}
+
+	// Order-preserving map of an integer key onto an unsigned word.
+	template <class T>
+	std::uint64_t toOrdered(T x)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			return x ? 1 : 0;
+		else
+		{
+			using U = std::make_unsigned_t<T>;
+			U bits = static_cast<U>(x);
+			if constexpr (std::is_signed_v<T>)
+				bits ^= U(1) << (std::numeric_limits<U>::digits - 1);
+			return bits;
+		}
+	}
+
+	template <class T>
+	T fromOrdered(std::uint64_t word)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			return word != 0;
+		else
+		{
+			using U = std::make_unsigned_t<T>;
+			U bits = static_cast<U>(word);
+			if constexpr (std::is_signed_v<T>)
+				bits ^= U(1) << (std::numeric_limits<U>::digits - 1);
+			return static_cast<T>(bits);
+		}
+	}
+
+	// Buffered payload writer that keeps a running CRC of what it wrote.
+	template <class T>
+	class Writer
+	{
+	private:
+		static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+		static constexpr std::size_t MAX_VARINT = 10;
+
+		std::FILE* file;
+		Crc32 crc;
+		std::uint64_t written = 0;
+		std::uint64_t previous = 0;
+		bool ok = true;
+		std::size_t used = 0;
+		unsigned char buffer[BUFFER_SIZE];
+
+		void varint_(std::uint64_t value)
+		{
+			if (BUFFER_SIZE - used < MAX_VARINT)
+				this->flush();
+			while (value >= 0x80)
+			{
+				buffer[used++] = static_cast<unsigned char>(value | 0x80);
+				value >>= 7;
+			}
+			buffer[used++] = static_cast<unsigned char>(value);
+		}
+
+		void bytes_(const void* data, std::size_t length)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			while (length != 0)
+			{
+				if (used == BUFFER_SIZE)
+					this->flush();
+				std::size_t chunk = std::min(length, BUFFER_SIZE - used);
+				std::memcpy(buffer + used, bytes, chunk);
+				used += chunk;
+				bytes += chunk;
+				length -= chunk;
+			}
+		}
+
+		template <class U>
+		void littleEndian_(U value)
+		{
+			unsigned char bytes[sizeof(U)];
+			for (std::size_t i = 0; i < sizeof(U); ++i)
+				bytes[i] = static_cast<unsigned char>(static_cast<std::uint64_t>(value) >> (8 * i));
+			this->bytes_(bytes, sizeof(U));
+		}
+
+	public:
+		explicit Writer(std::FILE* file)
+			: file(file) {}
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		void operator()(const T& x)
+		{
+			if constexpr (std::is_integral_v<T>)
+			{
+				std::uint64_t ordered = toOrdered(x);
+				this->varint_(ordered - previous);
+				previous = ordered;
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+				this->littleEndian_(std::bit_cast<Bits>(x));
+			}
+			else
+			{
+				this->varint_(x.size());
+				this->bytes_(x.data(), x.size());
+			}
+		}
+
+		void flush()
+		{
+			if (used == 0)
+				return;
+			crc.update(buffer, used);
+			ok = ok && std::fwrite(buffer, 1, used, file) == used;
+			written += used;
+			used = 0;
+		}
+
+		// Flushes the payload and appends the trailer.
+		bool finish()
+		{
+			this->flush();
+			std::uint64_t payloadBytes = written;
+			std::uint32_t checksum = crc.value();
+			this->littleEndian_(payloadBytes);
+			this->littleEndian_(checksum);
+			ok = ok && std::fwrite(buffer, 1, used, file) == used;
+			used = 0;
+			return ok;
+		}
+	};
+
+	inline std::uint64_t readLittleEndian(const unsigned char* bytes, std::size_t count)
+	{
+		std::uint64_t value = 0;
+		for (std::size_t i = 0; i < count; ++i)
+			value |= std::uint64_t(bytes[i]) << (8 * i);
+		return value;
+	}
+
+	inline bool readAll(const std::string& path, std::vector<unsigned char>& contents)
+	{
+		FilePtr file = open(path, "rb");
+		if (!file)
+			return false;
+		constexpr std::size_t CHUNK = 1 << 20;
+		contents.clear();
+		while (true)
+		{
+			std::size_t used = contents.size();
+			contents.resize(used + CHUNK);
+			std::size_t got = std::fread(contents.data() + used, 1, CHUNK, file.get());
+			contents.resize(used + got);
+			if (got < CHUNK)
+				return std::ferror(file.get()) == 0;
+		}
+	}
+
+	// Writes count keys produced in order by forEach(sink).
+	template <class T, class ForEach>
+	bool save(const std::string& path, std::uint64_t count, ForEach&& forEach)
+	{
+		FilePtr file = open(path, "wb");
+		if (!file)
+			return false;
+		unsigned char header[HEADER_BYTES] = {};
+		std::memcpy(header, MAGIC, 4);
+		header[4] = static_cast<unsigned char>(VERSION);
+		header[5] = static_cast<unsigned char>(VERSION >> 8);
+		header[6] = static_cast<unsigned char>(encodingOf<T>());
+		header[7] = keyBytesOf<T>();
+		for (std::size_t i = 0; i < 8; ++i)
+			header[8 + i] = static_cast<unsigned char>(count >> (8 * i));
+		if (std::fwrite(header, 1, HEADER_BYTES, file.get()) != HEADER_BYTES)
+			return false;
+
+		auto writer = std::make_unique<Writer<T>>(file.get());
+		forEach(*writer);
+		return writer->finish() && std::fflush(file.get()) == 0;
+	}
+
+	// Reads a file written by save into keys. Returns false, leaving keys in
+	// an unspecified state, if the file is missing, truncated, of another key
+	// type or fails its checksum.
+	template <class T>
+	bool load(const std::string& path, std::vector<T>& keys)
+	{
+		std::vector<unsigned char> contents;
+		if (!readAll(path, contents) || contents.size() < HEADER_BYTES + TRAILER_BYTES)
+			return false;
+		const unsigned char* header = contents.data();
+		if (std::memcmp(header, MAGIC, 4) != 0 || readLittleEndian(header + 4, 2) != VERSION
+			|| header[6] != static_cast<unsigned char>(encodingOf<T>()) || header[7] != keyBytesOf<T>())
+			return false;
+		std::uint64_t count = readLittleEndian(header + 8, 8);
+
+		const unsigned char* payload = header + HEADER_BYTES;
+		const unsigned char* trailer = contents.data() + contents.size() - TRAILER_BYTES;
+		std::uint64_t payloadBytes = readLittleEndian(trailer, 8);
+		if (payloadBytes != std::uint64_t(trailer - payload))
+			return false;
+		Crc32 crc;
+		crc.update(payload, std::size_t(payloadBytes));
+		if (crc.value() != readLittleEndian(trailer + 8, 4))
+			return false;
+
+		const unsigned char* cursor = payload;
+		auto varint = [&](std::uint64_t& value) {
+			value = 0;
+			for (int shift = 0; cursor < trailer && shift < 64; shift += 7)
+			{
+				unsigned char byte = *cursor++;
+				value |= std::uint64_t(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return true;
+			}
+			return false;
+		};
+
+		keys.clear();
+		keys.reserve(std::size_t(std::min<std::uint64_t>(count, payloadBytes)));
+		std::uint64_t previous = 0;
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			if constexpr (std::is_integral_v<T>)
+			{
+				std::uint64_t delta;
+				if (!varint(delta))
+					return false;
+				previous += delta;
+				keys.push_back(fromOrdered<T>(previous));
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+				if (std::size_t(trailer - cursor) < sizeof(T))
+					return false;
+				keys.push_back(std::bit_cast<T>(static_cast<Bits>(readLittleEndian(cursor, sizeof(T)))));
+				cursor += sizeof(T);
+			}
+			else
+			{
+				std::uint64_t length;
+				if (!varint(length) || std::uint64_t(trailer - cursor) < length)
+					return false;
+				keys.emplace_back(reinterpret_cast<const char*>(cursor), std::size_t(length));
+				cursor += length;
+			}
+		}
+		return cursor == trailer;
+	}
+}
+
+#endif // !TREE_FILE
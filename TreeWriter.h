@@ -0,0 +1,95 @@
+// Mateusz Kawa
+
+#ifndef TREE_WRITER
+#define TREE_WRITER
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Visitor sink for bulk export: keys are formatted with std::to_chars into a
+// fixed buffer and handed to the FILE in large blocks. A failed write is
+// remembered; check good() (or the result of flush()) once the export is done.
+class BufferedWriter
+{
+private:
+	static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+	static constexpr std::size_t MAX_KEY_CHARS = 64;
+
+	std::FILE* file;
+	char separator;
+	std::size_t used = 0;
+	bool ok = true;
+	char buffer[BUFFER_SIZE];
+
+public:
+	explicit BufferedWriter(std::FILE* file, char separator = ' ')
+		: file(file), separator(separator) {}
+
+	BufferedWriter(const BufferedWriter&) = delete;
+	BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+	~BufferedWriter()
+	{
+		this->flush();
+	}
+
+	template <class T>
+	void operator()(const T& x)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			char text[2] = { x ? '1' : '0', separator };
+			this->write(text, 2);
+		}
+		else if constexpr (std::is_arithmetic_v<T>)
+		{
+			if (BUFFER_SIZE - used < MAX_KEY_CHARS)
+				this->flush();
+			char* end = std::to_chars(buffer + used, buffer + BUFFER_SIZE - 1, x).ptr;
+			*end++ = separator;
+			used = static_cast<std::size_t>(end - buffer);
+		}
+		else
+		{
+			std::string_view text(x);
+			this->write(text.data(), text.size());
+			this->write(&separator, 1);
+		}
+	}
+
+	void write(const char* data, std::size_t length)
+	{
+		if (length > BUFFER_SIZE - used)
+		{
+			this->flush();
+			if (length > BUFFER_SIZE)
+			{
+				ok = std::fwrite(data, 1, length, file) == length && ok;
+				return;
+			}
+		}
+		std::memcpy(buffer + used, data, length);
+		used += length;
+	}
+
+	bool flush()
+	{
+		if (used != 0)
+			ok = std::fwrite(buffer, 1, used, file) == used && ok;
+		used = 0;
+		// The block is already large; pushing it through stdio now is what
+		// lets a full disk show up here rather than at fclose.
+		ok = std::fflush(file) == 0 && ok;
+		return ok;
+	}
+
+	bool good() const
+	{
+		return ok;
+	}
+};
+
+#endif // !TREE_WRITER
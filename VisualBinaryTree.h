@@ -4,9 +4,13 @@
 #define VISUAL_BINARY_TREE
 
 #include "SFML/Graphics.hpp"
+#include "MemoryStats.h"
+#include "TreeWalk.h"
 #include <string>
 #include <iostream>
 #include <cmath>
+#include <charconv>
+#include <utility>
 
 namespace vbt
 {
@@ -197,34 +201,12 @@ namespace vbt
 			return;
 		}
 
-		void inorder_(node_ptr node, std::string& text)
+		static void appendKey_(std::string& text, const T& key)
 		{
-			if (node != nullptr)
-			{
-				this->inorder_(node->left, text);
-				text += std::to_string(node->key) + " ";
-				this->inorder_(node->right, text);
-			}
-		}
-
-		void preorder_(node_ptr node, std::string& text)
-		{
-			if (node != nullptr)
-			{
-				text += std::to_string(node->key) + " ";
-				this->inorder_(node->left, text);
-				this->inorder_(node->right, text);
-			}
-		}
-
-		void postorder_(node_ptr node, std::string& text)
-		{
-			if (node != nullptr)
-			{
-				this->inorder_(node->left, text);
-				this->inorder_(node->right, text);
-				text += std::to_string(node->key) + " ";
-			}
+			char buffer[32];
+			char* end = std::to_chars(buffer, buffer + sizeof(buffer), key).ptr;
+			text.append(buffer, end);
+			text += ' ';
 		}
 
 		void passingTheNodes(node_ptr node, T& key, std::string& alert)
@@ -519,24 +501,55 @@ namespace vbt
 
 		int depth() { return this->depth_(root); }
 
+		template <class F>
+		void visitInorder(F&& visit) const
+		{
+			walkInorder(root, [&](node_ptr node) { visit(std::as_const(node->key)); });
+		}
+
+		template <class F>
+		void visitPreorder(F&& visit) const
+		{
+			walkPreorder(root, [&](node_ptr node) { visit(std::as_const(node->key)); });
+		}
+
+		template <class F>
+		void visitPostorder(F&& visit) const
+		{
+			walkPostorder(root, [&](node_ptr node) { visit(std::as_const(node->key)); });
+		}
+
+		template <class F>
+		void visitLevelorder(F&& visit) const
+		{
+			walkLevelorder(root, [&](node_ptr node) { visit(std::as_const(node->key)); });
+		}
+
 		std::string inorder()
 		{
 			std::string text;
-			this->inorder_(root, text);
+			this->visitInorder([&](const T& key) { appendKey_(text, key); });
 			return text;
 		}
 
 		std::string preorder()
 		{
 			std::string text;
-			this->preorder_(root, text);
+			this->visitPreorder([&](const T& key) { appendKey_(text, key); });
 			return text;
 		}
 
 		std::string postorder()
 		{
 			std::string text;
-			this->postorder_(root, text);
+			this->visitPostorder([&](const T& key) { appendKey_(text, key); });
+			return text;
+		}
+
+		std::string levelorder()
+		{
+			std::string text;
+			this->visitLevelorder([&](const T& key) { appendKey_(text, key); });
 			return text;
 		}
 
@@ -630,6 +643,24 @@ namespace vbt
 			return this->size;
 		}
 
+		// Every node is its own heap allocation, and its circle and text keep
+		// vertex arrays of their own: point count + 2 vertices for the circle
+		// and six per glyph for the text, as SFML 2.6 generates them.
+		MemoryStats memory_stats() const
+		{
+			MemoryStats stats;
+			walkInorder(root, [&](node_ptr node) {
+				std::size_t circleBytes = (node->circle.getPointCount() + 2) * sizeof(sf::Vertex);
+				std::size_t textBytes = node->text.getString().getSize() * 6 * sizeof(sf::Vertex);
+				++stats.nodes;
+				stats.nodeBytes += sizeof(VisualBinaryNode<T>);
+				stats.heapBytes += circleBytes + textBytes;
+				stats.allocatorOverhead += allocationOverhead(sizeof(VisualBinaryNode<T>))
+					+ allocationOverhead(circleBytes) + allocationOverhead(textBytes);
+			});
+			return stats;
+		}
+
 		float getWidth()
 		{
 			float sum = 0;
@@ -0,0 +1,424 @@
+// Mateusz Kawa
+
+#ifndef BENCH_CASES
+#define BENCH_CASES
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BenchSupport.h"
+
+// The case runner behind BinaryTreeBench and EngineBench, in the spirit of
+// Google Benchmark: every case repeats until it has run for --min-time
+// seconds and reports the mean time per item. A program supplies its op
+// names, which distributions each op applies to, and a function that runs
+// one case.
+//
+// Distributions give the insertion order of the keys 0..n-1: uniform is a
+// random permutation, sorted and reverse are what they say, and zig-zag
+// alternates between the smallest and the largest key left. The last three
+// build a list-shaped BinaryTree, so ops whose setup inserts them one by
+// one run up to --max-degenerate keys only. Zipfian is a lookup skew (YCSB, theta 0.99, over scrambled ranks)
+// on a uniformly built tree.
+//
+// Ops that follow a case as it runs record it in windows; --windows=file
+// writes them, one CSV row per window of every case, for plotting.
+
+namespace bench
+{
+	enum class Distribution { Uniform, Sorted, Reverse, ZigZag, Zipfian };
+
+	inline const char* distributionName(Distribution distribution)
+	{
+		switch (distribution)
+		{
+		case Distribution::Uniform: return "uniform";
+		case Distribution::Sorted: return "sorted";
+		case Distribution::Reverse: return "reverse";
+		case Distribution::ZigZag: return "zigzag";
+		case Distribution::Zipfian: return "zipfian";
+		}
+		return "";
+	}
+
+	inline bool degenerate(Distribution distribution)
+	{
+		return distribution == Distribution::Sorted || distribution == Distribution::Reverse
+			|| distribution == Distribution::ZigZag;
+	}
+
+	struct Options
+	{
+		double minTime = 0.5;
+		std::size_t maxSize = 1'000'000;
+		std::size_t maxDegenerate = 10'000;
+		unsigned maxThreads = 64;
+		std::size_t queries = 1 << 20;
+		std::uint64_t seed = 42;
+		std::string filter;
+		std::string format = "console";
+		std::string out;
+		std::string windows;
+	};
+
+	// Tail of a latency distribution, in nanoseconds.
+	struct Tail
+	{
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double max = 0.0;
+	};
+
+	// A slice of a case as it runs: the keys in the tree at its end, the
+	// time spent inserting and rebuilding during it, in nanoseconds, and the
+	// mean time of a lookup made right after it.
+	struct Window
+	{
+		std::size_t keys = 0;
+		double insertNs = 0.0;
+		double rebuildNs = 0.0;
+		std::size_t rebuilds = 0;
+		double lookupNs = 0.0;
+	};
+
+	// Nearest-rank percentiles of samples. Sorts samples.
+	inline Tail tailOf(std::vector<float>& samples)
+	{
+		Tail tail;
+		if (samples.empty())
+			return tail;
+		std::sort(samples.begin(), samples.end());
+		auto rank = [&](double quantile) {
+			return double(samples[std::min(std::size_t(quantile * double(samples.size())), samples.size() - 1)]);
+		};
+		tail.p99 = rank(0.99);
+		tail.p999 = rank(0.999);
+		tail.max = double(samples.back());
+		return tail;
+	}
+
+	struct Result
+	{
+		std::string name;
+		std::string op;
+		Distribution distribution;
+		std::size_t size;
+		std::size_t iterations = 0;
+		// Totals over all iterations, in nanoseconds.
+		double realTime = 0.0;
+		double cpuTime = 0.0;
+		std::size_t items = 0;
+		int depth = 0;
+		// Resident set size before the timed work and its peak during it,
+		// for ops that measure memory; 0 otherwise.
+		std::size_t rssBefore = 0;
+		std::size_t peakRss = 0;
+		// Size of the file an op writes or reads, for ops that use one; 0
+		// otherwise.
+		std::size_t fileBytes = 0;
+		// Latency of single lookups and of the maintenance steps between
+		// them, for ops that sample them; all 0 otherwise.
+		Tail lookupTail = {};
+		Tail stepTail = {};
+		// The windows of the last iteration, for ops that record them.
+		std::vector<Window> windows = {};
+
+		double nsPerItem() const { return items == 0 ? 0.0 : realTime / double(items); }
+		double bytesPerItem() const { return size == 0 ? 0.0 : double(fileBytes) / double(size); }
+		double megabytesPerSecond() const { return realTime == 0.0 ? 0.0 : double(fileBytes) * double(iterations) * 1e3 / realTime; }
+		double itemsPerSecond() const { return realTime == 0.0 ? 0.0 : double(items) * 1e9 / realTime; }
+	};
+
+	inline std::vector<int> insertionOrder(Distribution distribution, std::size_t n, std::uint64_t seed)
+	{
+		std::vector<int> keys(n);
+		for (std::size_t i = 0; i < n; ++i)
+			keys[i] = int(i);
+		switch (distribution)
+		{
+		case Distribution::Uniform:
+		case Distribution::Zipfian:
+		{
+			std::mt19937_64 rng(seed);
+			std::shuffle(keys.begin(), keys.end(), rng);
+			break;
+		}
+		case Distribution::Sorted:
+			break;
+		case Distribution::Reverse:
+			std::reverse(keys.begin(), keys.end());
+			break;
+		case Distribution::ZigZag:
+			for (std::size_t i = 0, low = 0, high = n; i < n; ++i)
+				keys[i] = int(i % 2 == 0 ? low++ : --high);
+			break;
+		}
+		return keys;
+	}
+
+	inline std::vector<int> lookupKeys(Distribution distribution, std::size_t n, std::size_t count, std::uint64_t seed)
+	{
+		std::vector<int> keys(count);
+		std::mt19937_64 rng(seed ^ 0x5EA5C4ull);
+		if (distribution == Distribution::Zipfian)
+		{
+			Zipfian zipf(n);
+			for (int& key : keys)
+				key = int(splitmix64(zipf(rng)) % n);
+		}
+		else
+		{
+			std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+			for (int& key : keys)
+				key = int(pick(rng));
+		}
+		return keys;
+	}
+
+	template <class Tree>
+	void build(Tree& tree, const std::vector<int>& keys)
+	{
+		for (int key : keys)
+			tree.insert(key);
+	}
+
+	inline double cpuNow()
+	{
+		return double(std::clock()) * 1e9 / CLOCKS_PER_SEC;
+	}
+
+	// Calls body until the timed total reaches minTime. body returns the
+	// nanoseconds it measured itself, so setup and teardown stay untimed;
+	// when setup dominates (clear after a quadratic build) the case also
+	// stops once five times minTime has passed on the wall clock.
+	inline void runTimed(Result& result, double minTime, std::size_t itemsPerIteration, const std::function<double(double&)>& body)
+	{
+		Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(5.0 * minTime));
+		while (result.iterations == 0 || (result.realTime < minTime * 1e9 && Clock::now() < deadline))
+		{
+			double cpu = 0.0;
+			result.realTime += body(cpu);
+			result.cpuTime += cpu;
+			result.items += itemsPerIteration;
+			++result.iterations;
+		}
+	}
+
+	template <class F>
+	double timed(double& cpu, F&& work)
+	{
+		double cpuStart = cpuNow();
+		Clock::time_point start = Clock::now();
+		work();
+		double real = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		cpu = cpuNow() - cpuStart;
+		return real;
+	}
+
+	inline void writeJson(std::ostream& out, const std::vector<Result>& results, const Options& options)
+	{
+		out << "{\n";
+		writeJsonContext(out, options.minTime, options.seed);
+		out << ",\n  \"benchmarks\": [";
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			out << (i == 0 ? "\n" : ",\n") << "    {\n";
+			out << "      \"name\": \"" << r.name << "\",\n";
+			out << "      \"op\": \"" << r.op << "\",\n";
+			out << "      \"distribution\": \"" << distributionName(r.distribution) << "\",\n";
+			out << "      \"size\": " << r.size << ",\n";
+			out << "      \"iterations\": " << r.iterations << ",\n";
+			out << "      \"real_time\": " << r.realTime / double(r.iterations) << ",\n";
+			out << "      \"cpu_time\": " << r.cpuTime / double(r.iterations) << ",\n";
+			out << "      \"time_unit\": \"ns\",\n";
+			out << "      \"ns_per_item\": " << r.nsPerItem() << ",\n";
+			out << "      \"items_per_second\": " << r.itemsPerSecond() << ",\n";
+			if (r.peakRss != 0)
+			{
+				out << "      \"rss_before_bytes\": " << r.rssBefore << ",\n";
+				out << "      \"peak_rss_bytes\": " << r.peakRss << ",\n";
+			}
+			if (r.fileBytes != 0)
+			{
+				out << "      \"file_bytes\": " << r.fileBytes << ",\n";
+				out << "      \"bytes_per_key\": " << r.bytesPerItem() << ",\n";
+				out << "      \"megabytes_per_second\": " << r.megabytesPerSecond() << ",\n";
+			}
+			if (r.lookupTail.max != 0.0)
+			{
+				out << "      \"lookup_p99_ns\": " << r.lookupTail.p99 << ",\n";
+				out << "      \"lookup_p99_9_ns\": " << r.lookupTail.p999 << ",\n";
+				out << "      \"lookup_max_ns\": " << r.lookupTail.max << ",\n";
+				out << "      \"step_p99_ns\": " << r.stepTail.p99 << ",\n";
+				out << "      \"step_p99_9_ns\": " << r.stepTail.p999 << ",\n";
+				out << "      \"step_max_ns\": " << r.stepTail.max << ",\n";
+			}
+			out << "      \"depth\": " << r.depth << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	inline void writeCsv(std::ostream& out, const std::vector<Result>& results)
+	{
+		out << "name,op,distribution,size,iterations,real_time_ns,cpu_time_ns,ns_per_item,items_per_second,depth,"
+			"rss_before_bytes,peak_rss_bytes,lookup_p99_ns,lookup_p99_9_ns,lookup_max_ns,step_p99_ns,step_p99_9_ns,step_max_ns,"
+			"file_bytes,bytes_per_key,megabytes_per_second\n";
+		for (const Result& r : results)
+			out << r.name << ',' << r.op << ',' << distributionName(r.distribution) << ',' << r.size << ','
+				<< r.iterations << ',' << r.realTime / double(r.iterations) << ',' << r.cpuTime / double(r.iterations) << ','
+				<< r.nsPerItem() << ',' << r.itemsPerSecond() << ',' << r.depth << ',' << r.rssBefore << ',' << r.peakRss << ','
+				<< r.lookupTail.p99 << ',' << r.lookupTail.p999 << ',' << r.lookupTail.max << ','
+				<< r.stepTail.p99 << ',' << r.stepTail.p999 << ',' << r.stepTail.max << ','
+				<< r.fileBytes << ',' << r.bytesPerItem() << ',' << r.megabytesPerSecond() << '\n';
+	}
+
+	inline void writeWindows(std::ostream& out, const std::vector<Result>& results)
+	{
+		out << "name,op,distribution,size,window,keys,insert_ns,rebuild_ns,rebuilds,lookup_ns\n";
+		for (const Result& r : results)
+			for (std::size_t i = 0; i < r.windows.size(); ++i)
+			{
+				const Window& w = r.windows[i];
+				out << r.name << ',' << r.op << ',' << distributionName(r.distribution) << ',' << r.size << ',' << i << ','
+					<< w.keys << ',' << w.insertNs << ',' << w.rebuildNs << ',' << w.rebuilds << ',' << w.lookupNs << '\n';
+			}
+	}
+
+	inline void printRow(std::FILE* table, const Result& r)
+	{
+		std::fprintf(table, "%-40s %14.0f ns %14.0f ns %10zu %10.2f ns/item %6d\n", r.name.c_str(),
+			r.realTime / double(r.iterations), r.cpuTime / double(r.iterations), r.iterations, r.nsPerItem(), r.depth);
+		if (r.peakRss != 0)
+			std::fprintf(table, "%-40s peak RSS %.1f MB, %.1f MB above the %.1f MB before\n", "", double(r.peakRss) / 1e6,
+				(double(r.peakRss) - double(r.rssBefore)) / 1e6, double(r.rssBefore) / 1e6);
+		if (r.fileBytes != 0)
+			std::fprintf(table, "%-40s file %.1f MB, %.2f bytes per key, %.0f MB/s\n", "", double(r.fileBytes) / 1e6,
+				r.bytesPerItem(), r.megabytesPerSecond());
+		if (r.lookupTail.max != 0.0)
+			std::fprintf(table, "%-40s lookups p99 %.0f / p99.9 %.0f / max %.0f ns, steps p99 %.0f / p99.9 %.0f / max %.0f ns\n", "",
+				r.lookupTail.p99, r.lookupTail.p999, r.lookupTail.max, r.stepTail.p99, r.stepTail.p999, r.stepTail.max);
+		std::fflush(table);
+	}
+
+	inline bool parseArgument(const std::string& arg, Options& options)
+	{
+		std::size_t eq = arg.find('=');
+		if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+			return false;
+		std::string key = arg.substr(2, eq - 2);
+		std::string value = arg.substr(eq + 1);
+		if (key == "min-time")
+			options.minTime = std::atof(value.c_str());
+		else if (key == "max-size")
+			options.maxSize = std::size_t(std::atof(value.c_str()));
+		else if (key == "max-degenerate")
+			options.maxDegenerate = std::size_t(std::atof(value.c_str()));
+		else if (key == "max-threads")
+			options.maxThreads = unsigned(std::max(1, std::atoi(value.c_str())));
+		else if (key == "queries")
+			options.queries = std::size_t(std::atof(value.c_str()));
+		else if (key == "seed")
+			options.seed = std::strtoull(value.c_str(), nullptr, 10);
+		else if (key == "filter")
+			options.filter = value;
+		else if (key == "format" && (value == "console" || value == "json" || value == "csv"))
+			options.format = value;
+		else if (key == "out")
+			options.out = value;
+		else if (key == "windows")
+			options.windows = value;
+		else
+			return false;
+		return true;
+	}
+
+	// Parses the command line into options, or prints the usage and
+	// returns false.
+	inline bool parseArguments(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (!parseArgument(argv[i], options))
+			{
+				std::cerr << "usage: " << argv[0] << " [--min-time=s] [--max-size=n] [--max-degenerate=n] [--max-threads=n] [--queries=n]"
+					" [--seed=n] [--filter=substring] [--format=console|json|csv] [--out=file]"
+					" [--windows=file]" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Runs every op on every distribution and size it applies to, for sizes
+	// from 1e3 by powers of ten up to --max-size (at most 1e8), and writes
+	// the report options ask for. Returns the exit status.
+	inline int runCases(const Options& options, const std::vector<std::string>& ops,
+		const std::function<bool(const std::string&, Distribution, std::size_t, const Options&)>& applies,
+		const std::function<Result(const std::string&, Distribution, std::size_t, const Options&)>& runCase)
+	{
+		const Distribution distributions[] = { Distribution::Uniform, Distribution::Sorted, Distribution::Reverse,
+			Distribution::ZigZag, Distribution::Zipfian };
+
+		// The table goes to stderr when stdout carries the JSON or CSV.
+		std::FILE* table = options.format != "console" && options.out.empty() ? stderr : stdout;
+		std::fprintf(table, "%-40s %17s %17s %10s %18s %6s\n", "Benchmark", "Time", "CPU", "Iterations", "Per item", "Depth");
+		std::vector<Result> results;
+		for (std::size_t n = 1000; n <= options.maxSize && n <= 100'000'000; n *= 10)
+			for (Distribution distribution : distributions)
+				for (const std::string& op : ops)
+				{
+					if (!applies(op, distribution, n, options))
+						continue;
+					std::string name = "BM_" + op + "/" + distributionName(distribution) + "/" + std::to_string(n);
+					if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+						continue;
+					results.push_back(runCase(op, distribution, n, options));
+					printRow(table, results.back());
+				}
+
+		if (!options.windows.empty())
+		{
+			std::ofstream windows(options.windows);
+			if (!windows)
+			{
+				std::cerr << "Cannot open " << options.windows << std::endl;
+				return EXIT_FAILURE;
+			}
+			writeWindows(windows, results);
+		}
+
+		if (options.format == "console")
+			return EXIT_SUCCESS;
+		std::ofstream file;
+		if (!options.out.empty())
+		{
+			file.open(options.out);
+			if (!file)
+			{
+				std::cerr << "Cannot open " << options.out << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		std::ostream& out = options.out.empty() ? std::cout : file;
+		if (options.format == "json")
+			writeJson(out, results, options);
+		else
+			writeCsv(out, results);
+		return EXIT_SUCCESS;
+	}
+}
+
+#endif // !BENCH_CASES
@@ -0,0 +1,153 @@
+// Mateusz Kawa
+
+#ifndef BENCH_SUPPORT
+#define BENCH_SUPPORT
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+
+// Pieces shared by the benchmark programs in this directory.
+
+namespace bench
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Keeps the compiler from dropping a computation whose result is unused.
+	template <class T>
+	void doNotOptimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	inline std::uint64_t splitmix64(std::uint64_t x)
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	// Gray et al.'s generator, as used by YCSB: ranks 0..n-1, rank 0 the
+	// most popular.
+	class Zipfian
+	{
+	private:
+		std::size_t n;
+		double theta, alpha, zetan, eta;
+
+		static double zeta(std::size_t n, double theta)
+		{
+			double sum = 0.0;
+			for (std::size_t i = 1; i <= n; ++i)
+				sum += 1.0 / std::pow(double(i), theta);
+			return sum;
+		}
+
+	public:
+		Zipfian(std::size_t n, double theta = 0.99)
+			: n(n), theta(theta), alpha(1.0 / (1.0 - theta)), zetan(zeta(n, theta))
+		{
+			double zeta2 = zeta(2, theta);
+			eta = (1.0 - std::pow(2.0 / double(n), 1.0 - theta)) / (1.0 - zeta2 / zetan);
+		}
+
+		template <class Rng>
+		std::size_t operator()(Rng& rng)
+		{
+			double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+			double uz = u * zetan;
+			if (uz < 1.0)
+				return 0;
+			if (uz < 1.0 + std::pow(0.5, theta))
+				return 1;
+			return std::min(n - 1, std::size_t(double(n) * std::pow(eta * u - eta + 1.0, alpha)));
+		}
+	};
+
+	// Resident set size of the process in bytes, now or at its peak since
+	// the last resetPeakRss(). Only Linux reports them; elsewhere they are 0.
+	inline std::size_t rssField_(const char* field)
+	{
+#ifdef __linux__
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		std::size_t length = std::char_traits<char>::length(field);
+		while (std::getline(status, line))
+			if (line.compare(0, length, field) == 0)
+				return std::size_t(std::strtoull(line.c_str() + length, nullptr, 10)) * 1024;
+#else
+		(void)field;
+#endif
+		return 0;
+	}
+
+	inline std::size_t currentRss()
+	{
+		return rssField_("VmRSS:");
+	}
+
+	inline std::size_t peakRss()
+	{
+		return rssField_("VmHWM:");
+	}
+
+	// Where the kernel does not allow the reset, peakRss() stays the peak
+	// over the life of the process.
+	inline void resetPeakRss()
+	{
+#ifdef __linux__
+		std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+	}
+
+	inline std::string jsonEscape(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	// The "context" object of a Google Benchmark style JSON report, up to
+	// and including its closing brace.
+	inline void writeJsonContext(std::ostream& out, double minTime, std::uint64_t seed)
+	{
+		char date[32];
+		std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+		out << "  \"context\": {\n";
+		out << "    \"date\": \"" << date << "\",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#if defined(__VERSION__)
+		out << "    \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n";
+#endif
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\",\n";
+#else
+		out << "    \"library_build_type\": \"debug\",\n";
+#endif
+		out << "    \"min_time\": " << minTime << ",\n";
+		out << "    \"seed\": " << seed << "\n  }";
+	}
+}
+
+#endif // !BENCH_SUPPORT
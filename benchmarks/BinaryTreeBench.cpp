@@ -0,0 +1,379 @@
+// Mateusz Kawa
+
+// Headless microbenchmarks for BinaryTree, in the spirit of Google
+// Benchmark: every case repeats until it has run for --min-time seconds
+// and reports the mean time per item. Needs nothing but BinaryTree.h; the
+// engines and tools built around it are timed by EngineBench.cpp.
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -pthread -I.. BinaryTreeBench.cpp -o bench
+//   ./bench --max-size=1e6 --format=json --out=results.json
+//
+// Distributions are those of BenchCases.h. Sorted, reverse and zig-zag
+// make insertion quadratic and searchRecursive and depth recurse n deep;
+// zipfian applies to the search ops alone.
+//
+// searchBatch resolves the same queries as search through search_batch, in
+// chunks of 256 keys the way a request handler would.
+//
+// buildSorted is the serial bulk load from sorted keys; buildParallelN is
+// buildFromSortedParallel on a pool of N threads, for N doubling from 1 to
+// --max-threads. Both run on the uniform distribution only.
+//
+// rebalance times the in-place Day-Stout-Warren rebalance() of a tree built
+// in uniform, sorted or reverse order, and reports the peak resident set
+// size during it next to the size before, so that the memory it adds on
+// top of the nodes shows. The sorted and reverse trees are made list-shaped
+// in linear time (see makeVine), so they are not held to --max-degenerate;
+// --max-size=1e8 --filter=rebalance covers 100M-node lists in about 4.5 GB.
+//
+// rebalanceStepK runs an incremental rebalance of a uniformly built tree
+// with beginRebalance() and rebalanceStep(K), and times 16 random lookups
+// between two steps, on the same thread, the way a server would interleave
+// requests with background work. It reports the p99, p99.9 and maximum of
+// the single lookups and of the steps; the time per item is that of a
+// lookup plus its share of the steps. rebalanceIdle times the same lookups
+// with no rebalance running, as the baseline.
+//
+// rebuildOff, rebuildInline and rebuildDeferred insert the keys in sorted
+// order under that RebuildPolicy mode, in windows of 1024 keys. Deferred
+// calls maintain() at the end of every window, as a periodic background
+// task would. Each window records the time spent inserting, the time spent
+// rebuilding (the inserts that triggered an inline rebuild, or maintain)
+// and the mean of 256 random lookups made after it; --windows=file writes
+// them as CSV. Sorted input rebuilds the whole tree about once a window
+// under Deferred, so the run is quadratic, if 1024 times cheaper than Off,
+// which is held to --max-degenerate.
+//
+// save writes the tree with save() to a temporary file and load reads it
+// back with load(), which rebuilds the tree balanced from the sorted keys;
+// both report the size of the file per key, about one byte here, since the
+// keys 0..n-1 leave deltas of one between neighbours. buildByInsert inserts the same
+// keys one by one in random order, the way a tree is restored without a
+// file, as the baseline for load. All three run on uniform keys only.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "BenchCases.h"
+#include "BinaryTree.h"
+
+namespace bench
+{
+	using Tree = BinaryTree<int>;
+
+	// Keys per search_batch call, about what one request resolves.
+	constexpr std::size_t SEARCH_CHUNK = 256;
+
+	// Lookups timed between two rebalanceStep calls.
+	constexpr std::size_t LOOKUPS_PER_STEP = 16;
+
+	// Keys inserted per window of the rebuild ops, and lookups timed after
+	// each window.
+	constexpr std::size_t REBUILD_WINDOW = 1024;
+	constexpr std::size_t LOOKUPS_PER_WINDOW = 256;
+
+	bool applies(const std::string& op, Distribution distribution, std::size_t n, const Options& options)
+	{
+		if (op.rfind("rebalanceStep", 0) == 0 || op == "rebalanceIdle")
+			return distribution == Distribution::Uniform;
+		if (op == "save" || op == "load" || op == "buildByInsert")
+			return distribution == Distribution::Uniform;
+		if (op == "rebuildInline" || op == "rebuildDeferred")
+			return distribution == Distribution::Sorted;
+		if (op == "rebuildOff")
+			return distribution == Distribution::Sorted && n <= options.maxDegenerate;
+		if (op == "rebalance")
+			return distribution == Distribution::Uniform || distribution == Distribution::Sorted
+				|| distribution == Distribution::Reverse;
+		if (degenerate(distribution) && n > options.maxDegenerate)
+			return false;
+		if (op.rfind("build", 0) == 0 && distribution != Distribution::Uniform)
+			return false;
+		return distribution != Distribution::Zipfian || op.rfind("search", 0) == 0;
+	}
+
+	// Reshapes a tree holding the keys 0..n-1 into the list that inserting
+	// them in sorted (or reverse) order builds: a chain of right (or left)
+	// links from the smallest (or largest) key. Inserting them one by one
+	// would take quadratic time, so the nodes are relinked through getRoot()
+	// instead, keeping the root node on top, and take their keys in chain
+	// order.
+	void makeVine(Tree& tree, bool reverse)
+	{
+		std::vector<Tree::node_ptr> nodes;
+		nodes.reserve(std::size_t(tree.size()));
+		walkPreorder(tree.getRoot(), [&](Tree::node_ptr node) { nodes.push_back(node); });
+		for (std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			Tree::node_ptr next = i + 1 < nodes.size() ? nodes[i + 1] : nullptr;
+			nodes[i]->value = int(reverse ? nodes.size() - 1 - i : i);
+			nodes[i]->parent = i == 0 ? nullptr : nodes[i - 1];
+			nodes[i]->left = reverse ? next : nullptr;
+			nodes[i]->right = reverse ? nullptr : next;
+		}
+	}
+
+	Result runCase(const std::string& op, Distribution distribution, std::size_t n, const Options& options)
+	{
+		Result result{ "BM_" + op + "/" + distributionName(distribution) + "/" + std::to_string(n), op, distribution, n };
+		std::vector<int> keys = insertionOrder(distribution, n, options.seed);
+
+		if (op == "save" || op == "load")
+		{
+			std::string path = (std::filesystem::temp_directory_path()
+				/ ("BinaryTreeBench." + std::to_string(n) + ".bstf")).string();
+			Tree tree;
+			build(tree, keys);
+			result.depth = tree.depth();
+			if (!tree.save(path))
+			{
+				std::cerr << "Cannot write " << path << std::endl;
+				std::exit(EXIT_FAILURE);
+			}
+			result.fileBytes = std::size_t(std::filesystem::file_size(path));
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				if (op == "save")
+					return timed(cpu, [&] { doNotOptimize(tree.save(path)); });
+				Tree loaded;
+				double real = timed(cpu, [&] { doNotOptimize(loaded.load(path)); });
+				result.depth = loaded.depth();
+				return real;
+			});
+			std::filesystem::remove(path);
+			return result;
+		}
+		if (op == "insert" || op == "buildByInsert")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				Tree tree;
+				double real = timed(cpu, [&] { build(tree, keys); });
+				result.depth = tree.depth();
+				return real;
+			});
+			return result;
+		}
+		if (op == "buildSorted" || op.rfind("buildParallel", 0) == 0)
+		{
+			std::sort(keys.begin(), keys.end());
+			std::unique_ptr<tasks::ThreadPool> pool;
+			if (op != "buildSorted")
+				pool = std::make_unique<tasks::ThreadPool>(std::size_t(std::atoi(op.c_str() + 13)));
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				Tree tree;
+				double real = timed(cpu, [&] {
+					if (pool)
+						tree.buildFromSortedParallel(keys.begin(), keys.end(), *pool);
+					else
+						tree.buildFromSorted(keys.begin(), keys.end());
+				});
+				result.depth = tree.depth();
+				return real;
+			});
+			return result;
+		}
+		if (op == "rebalance")
+		{
+			std::sort(keys.begin(), keys.end());
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				Tree tree;
+				if (distribution == Distribution::Uniform)
+					build(tree, insertionOrder(distribution, n, options.seed));
+				else
+				{
+					tree.buildFromSorted(keys.begin(), keys.end());
+					makeVine(tree, distribution == Distribution::Reverse);
+				}
+				resetPeakRss();
+				std::size_t before = currentRss();
+				double real = timed(cpu, [&] { tree.rebalance(); });
+				std::size_t peak = peakRss();
+				if (peak - before >= result.peakRss - result.rssBefore)
+				{
+					result.rssBefore = before;
+					result.peakRss = peak;
+				}
+				result.depth = tree.depth();
+				return real;
+			});
+			return result;
+		}
+		if (op.rfind("rebalanceStep", 0) == 0 || op == "rebalanceIdle")
+		{
+			std::size_t budget = op == "rebalanceIdle" ? 0 : std::size_t(std::atoll(op.c_str() + 13));
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			std::vector<float> lookups;
+			std::vector<float> steps;
+			std::size_t next = 0;
+			runTimed(result, options.minTime, 0, [&](double& cpu) {
+				Tree tree;
+				build(tree, keys);
+				auto lookup = [&] {
+					Clock::time_point start = Clock::now();
+					doNotOptimize(tree.search(queries[next]));
+					lookups.push_back(std::chrono::duration<float, std::nano>(Clock::now() - start).count());
+					next = next + 1 == queries.size() ? 0 : next + 1;
+					++result.items;
+				};
+				double real = timed(cpu, [&] {
+					if (budget == 0)
+					{
+						for (std::size_t i = 0; i < queries.size(); ++i)
+							lookup();
+						return;
+					}
+					tree.beginRebalance();
+					bool done = false;
+					while (!done)
+					{
+						for (std::size_t i = 0; i < LOOKUPS_PER_STEP; ++i)
+							lookup();
+						Clock::time_point start = Clock::now();
+						done = tree.rebalanceStep(budget);
+						steps.push_back(std::chrono::duration<float, std::nano>(Clock::now() - start).count());
+					}
+				});
+				result.depth = tree.depth();
+				return real;
+			});
+			result.lookupTail = tailOf(lookups);
+			result.stepTail = tailOf(steps);
+			return result;
+		}
+		if (op.rfind("rebuild", 0) == 0)
+		{
+			Tree::RebuildPolicy policy;
+			policy.mode = op == "rebuildInline" ? Tree::RebuildMode::Inline
+				: op == "rebuildDeferred" ? Tree::RebuildMode::Deferred : Tree::RebuildMode::Off;
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				Tree tree;
+				tree.setRebuildPolicy(policy);
+				std::mt19937_64 rng(options.seed);
+				result.windows.clear();
+				double real = timed(cpu, [&] {
+					for (std::size_t begin = 0; begin < n; begin += REBUILD_WINDOW)
+					{
+						Window window;
+						std::size_t before = tree.rebuildCount();
+						for (std::size_t i = begin; i < std::min(n, begin + REBUILD_WINDOW); ++i)
+						{
+							std::size_t rebuilds = tree.rebuildCount();
+							Clock::time_point start = Clock::now();
+							tree.insert(keys[i]);
+							double nanos = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+							(tree.rebuildCount() == rebuilds ? window.insertNs : window.rebuildNs) += nanos;
+						}
+						Clock::time_point start = Clock::now();
+						tree.maintain();
+						window.rebuildNs += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+						window.rebuilds = tree.rebuildCount() - before;
+						window.keys = std::size_t(tree.size());
+
+						std::uniform_int_distribution<int> pick(0, int(window.keys) - 1);
+						start = Clock::now();
+						for (std::size_t i = 0; i < LOOKUPS_PER_WINDOW; ++i)
+							doNotOptimize(tree.search(pick(rng)));
+						window.lookupNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+							/ double(LOOKUPS_PER_WINDOW);
+						result.windows.push_back(window);
+					}
+				});
+				result.depth = tree.depth();
+				return real;
+			});
+			return result;
+		}
+		if (op == "clear")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				Tree tree;
+				build(tree, keys);
+				result.depth = tree.depth();
+				return timed(cpu, [&] { tree.clear(); });
+			});
+			return result;
+		}
+
+		Tree tree;
+		build(tree, keys);
+		result.depth = tree.depth();
+
+		if (op == "search" || op == "searchRecursive")
+		{
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			bool recursive = op == "searchRecursive";
+			runTimed(result, options.minTime, queries.size(), [&](double& cpu) {
+				return timed(cpu, [&] {
+					for (int key : queries)
+						doNotOptimize(recursive ? tree.searchRecursive(key) : tree.search(key));
+				});
+			});
+		}
+		else if (op == "searchBatch")
+		{
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			std::vector<Tree::node_ptr> found(queries.size());
+			runTimed(result, options.minTime, queries.size(), [&](double& cpu) {
+				return timed(cpu, [&] {
+					for (std::size_t first = 0; first < queries.size(); first += SEARCH_CHUNK)
+					{
+						std::size_t count = std::min(SEARCH_CHUNK, queries.size() - first);
+						tree.search_batch(std::span<const int>(queries.data() + first, count),
+							std::span<Tree::node_ptr>(found.data() + first, count));
+					}
+					doNotOptimize(found.back());
+				});
+			});
+		}
+		else if (op == "iterate")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				return timed(cpu, [&] {
+					long long sum = 0;
+					for (Tree::Iterator it = tree.begin(); it != tree.end(); ++it)
+						sum += *it;
+					doNotOptimize(sum);
+				});
+			});
+		}
+		else if (op == "levelorder")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				return timed(cpu, [&] {
+					long long sum = 0;
+					tree.visitLevelorder([&](int key) { sum += key; });
+					doNotOptimize(sum);
+				});
+			});
+		}
+		else if (op == "depth")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				return timed(cpu, [&] { doNotOptimize(tree.depth()); });
+			});
+		}
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Options options;
+	if (!bench::parseArguments(argc, argv, options))
+		return EXIT_FAILURE;
+
+	std::vector<std::string> ops = { "insert", "search", "searchRecursive", "searchBatch", "iterate", "levelorder", "depth",
+		"clear", "buildSorted", "rebalance", "rebalanceIdle", "rebuildOff", "rebuildInline", "rebuildDeferred", "save", "load", "buildByInsert" };
+	for (std::size_t budget : { 16, 256, 4096, 65536 })
+		ops.push_back("rebalanceStep" + std::to_string(budget));
+	for (unsigned threads = 1; threads <= options.maxThreads; threads *= 2)
+		ops.push_back("buildParallel" + std::to_string(threads));
+	return bench::runCases(options, ops, bench::applies, bench::runCase);
+}
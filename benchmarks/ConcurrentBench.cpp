@@ -0,0 +1,602 @@
+// Mateusz Kawa
+
+// Multi-threaded throughput of the concurrent trees. Every case fills an
+// engine with the even keys of 0..2n-1 in random order, starts its threads
+// together, lets them run for --min-time seconds and counts the operations
+// they complete. A write toggles a key: it removes the key, or inserts it
+// when it was absent, so the tree stays about n keys large.
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -pthread -I.. ConcurrentBench.cpp -o concurrent
+//   ./concurrent --max-threads=64 --format=json --out=concurrent.json
+//
+// Scenarios:
+//   readers  N threads look up random keys while one extra thread writes
+//            without pause; reports the lookups of the N readers.
+//   mixed    N threads each run lookups and writes, with 5%, 50% or 95%
+//            writes; reports all operations, and the latency of every
+//            64th one.
+//   skew     the mixed scenario at 50% writes with skewed keys: zipfian
+//            (YCSB, theta 0.99, hot keys scattered over the key space) or
+//            hotspot (90% of operations on the lowest 1/16 of the keys, so
+//            one key range takes most of the load).
+//   scans    N threads each open the latest MvccTree version and iterate
+//            it end to end, over and over, while one thread commits writes
+//            without pause; reports the commits, next to the commits of
+//            the same writer run first with no scanners, the full scans
+//            and the most versions alive at once.
+//
+// Thread counts above the number of cores oversubscribe the machine; that
+// is where a preempted lock holder stalls everyone queued behind it, which
+// the tail latencies of the mixed scenario show.
+//
+// Engines: mutex is BinaryTree behind one std::mutex, the way it is shared
+// today; optimistic is OptimisticTree with its per-node version locks; rcu
+// is RcuTree; lockfree is LockFreeTree; sharded is ShardedTree with 32
+// equal range shards and its background rebalancer running every 10 ms;
+// mvcc is MvccTree, one published version per commit, and runs the scans
+// scenario only, which no other engine runs.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "BenchSupport.h"
+#include "BinaryTree.h"
+#include "LockFreeTree.h"
+#include "MvccTree.h"
+#include "OptimisticTree.h"
+#include "RcuTree.h"
+#include "ShardedTree.h"
+
+namespace bench
+{
+	struct Options
+	{
+		double minTime = 0.5;
+		std::size_t size = 1'000'000;
+		unsigned maxThreads = 64;
+		std::uint64_t seed = 42;
+		std::string filter;
+		std::string format = "console";
+		std::string out;
+	};
+
+	struct Result
+	{
+		std::string name;
+		std::string scenario;
+		std::string engine;
+		unsigned threads = 0;
+		double writeRatio = 0.0;
+		double seconds = 0.0;
+		// Operations counted by the scenario, and the writes among all
+		// operations run.
+		std::uint64_t ops = 0;
+		std::uint64_t writes = 0;
+		// Sampled latency percentiles in nanoseconds; zero when not sampled.
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double max = 0.0;
+		// Scans scenario: commits per second with no scanners, full scans
+		// and the most versions alive at once; zero otherwise.
+		double baselineOpsPerSecond = 0.0;
+		std::uint64_t scans = 0;
+		int peakVersions = 0;
+
+		double opsPerSecond() const { return seconds == 0.0 ? 0.0 : double(ops) / seconds; }
+	};
+
+	enum class Distribution { Uniform, Zipfian, Hotspot };
+
+	// A scenario to run: its kind, its name in the results, its write ratio
+	// and the distribution of its keys.
+	struct Scenario
+	{
+		std::string kind;
+		std::string label;
+		double writeRatio;
+		Distribution distribution = Distribution::Uniform;
+	};
+
+	// Draws keys of 0..range-1. Copies are independent, so every thread
+	// takes one and the Zipfian table is built only once.
+	class KeyPicker
+	{
+	private:
+		static constexpr double HOT_SHARE = 0.9;
+		static constexpr std::size_t HOT_FRACTION = 16;
+
+		Distribution distribution;
+		std::size_t range;
+		std::optional<Zipfian> zipf;
+
+	public:
+		KeyPicker(Distribution distribution, std::size_t range)
+			: distribution(distribution), range(range)
+		{
+			if (distribution == Distribution::Zipfian)
+				zipf.emplace(range);
+		}
+
+		template <class Rng>
+		int operator()(Rng& rng)
+		{
+			switch (distribution)
+			{
+			case Distribution::Zipfian:
+				return int(splitmix64((*zipf)(rng)) % range);
+			case Distribution::Hotspot:
+			{
+				std::size_t hot = std::max<std::size_t>(range / HOT_FRACTION, 1);
+				if (std::bernoulli_distribution(HOT_SHARE)(rng))
+					return int(std::uniform_int_distribution<std::size_t>(0, hot - 1)(rng));
+				return int(std::uniform_int_distribution<std::size_t>(0, range - 1)(rng));
+			}
+			default:
+				return int(std::uniform_int_distribution<std::size_t>(0, range - 1)(rng));
+			}
+		}
+	};
+
+	class MutexTree
+	{
+	private:
+		std::mutex lock;
+		BinaryTree<int> tree;
+
+	public:
+		void insert(int key)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			tree.insert(key);
+		}
+
+		bool remove(int key)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return tree.remove(key);
+		}
+
+		bool contains(int key)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return tree.search(key) != nullptr;
+		}
+	};
+
+	class MvccEngine
+	{
+	private:
+		MvccTree<int> tree;
+
+	public:
+		void insert(int key)
+		{
+			tree.insert(key);
+		}
+
+		bool remove(int key)
+		{
+			return tree.remove(key) != 0;
+		}
+
+		bool contains(int key)
+		{
+			return tree.open().contains(key);
+		}
+
+		MvccTree<int>& versions()
+		{
+			return tree;
+		}
+	};
+
+	template <class Engine>
+	void toggle(Engine& engine, int key)
+	{
+		if (!engine.remove(key))
+			engine.insert(key);
+	}
+
+	constexpr std::size_t SHARDS = 32;
+
+	template <class Engine>
+	std::unique_ptr<Engine> makeEngine(const Options&)
+	{
+		return std::make_unique<Engine>();
+	}
+
+	template <>
+	std::unique_ptr<ShardedTree<int>> makeEngine<ShardedTree<int>>(const Options& options)
+	{
+		std::vector<int> boundaries;
+		for (std::size_t i = 1; i < SHARDS; ++i)
+			boundaries.push_back(int(2 * options.size * i / SHARDS));
+		auto engine = std::make_unique<ShardedTree<int>>(std::move(boundaries));
+		engine->startRebalancer(std::chrono::milliseconds(10));
+		return engine;
+	}
+
+	template <class Engine>
+	void prefill(Engine& engine, std::size_t n, std::uint64_t seed)
+	{
+		std::vector<int> keys(n);
+		for (std::size_t i = 0; i < n; ++i)
+			keys[i] = int(2 * i);
+		std::shuffle(keys.begin(), keys.end(), std::mt19937_64(seed));
+		for (int key : keys)
+			engine.insert(key);
+	}
+
+	// Starts body(index, stop) on `count` threads at once, stops them after
+	// minTime seconds and returns the seconds they actually ran.
+	double runThreads(unsigned count, double minTime, const std::function<void(unsigned, const std::atomic<bool>&)>& body)
+	{
+		std::atomic<unsigned> ready{ 0 };
+		std::atomic<bool> go{ false };
+		std::atomic<bool> stop{ false };
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < count; ++i)
+			threads.emplace_back([&, i] {
+				ready.fetch_add(1);
+				while (!go.load(std::memory_order_acquire))
+					std::this_thread::yield();
+				body(i, stop);
+			});
+		while (ready.load() != count)
+			std::this_thread::yield();
+		Clock::time_point start = Clock::now();
+		go.store(true, std::memory_order_release);
+		std::this_thread::sleep_for(std::chrono::duration<double>(minTime));
+		stop.store(true, std::memory_order_relaxed);
+		for (std::thread& thread : threads)
+			thread.join();
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	template <class Engine>
+	void runReaders(Result& result, const Scenario& scenario, const Options& options)
+	{
+		std::unique_ptr<Engine> owner = makeEngine<Engine>(options);
+		Engine& engine = *owner;
+		prefill(engine, options.size, options.seed);
+		KeyPicker picker(scenario.distribution, 2 * options.size);
+		std::atomic<std::uint64_t> lookups{ 0 };
+		std::atomic<std::uint64_t> writes{ 0 };
+		result.seconds = runThreads(result.threads + 1, options.minTime, [&](unsigned index, const std::atomic<bool>& stop) {
+			std::mt19937_64 rng(splitmix64(options.seed + index));
+			KeyPicker pick = picker;
+			std::uint64_t done = 0;
+			if (index == result.threads)
+			{
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					toggle(engine, pick(rng));
+					++done;
+				}
+				writes.fetch_add(done);
+				return;
+			}
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				doNotOptimize(engine.contains(pick(rng)));
+				++done;
+			}
+			lookups.fetch_add(done);
+		});
+		result.ops = lookups.load();
+		result.writes = writes.load();
+	}
+
+	template <class Engine>
+	void runMixed(Result& result, const Scenario& scenario, const Options& options)
+	{
+		constexpr std::uint64_t SAMPLE_EVERY = 64;
+		std::unique_ptr<Engine> owner = makeEngine<Engine>(options);
+		Engine& engine = *owner;
+		prefill(engine, options.size, options.seed);
+		KeyPicker picker(scenario.distribution, 2 * options.size);
+		std::atomic<std::uint64_t> ops{ 0 };
+		std::atomic<std::uint64_t> writes{ 0 };
+		std::mutex samplesLock;
+		std::vector<float> samples;
+		result.seconds = runThreads(result.threads, options.minTime, [&](unsigned index, const std::atomic<bool>& stop) {
+			std::mt19937_64 rng(splitmix64(options.seed + index));
+			KeyPicker pick = picker;
+			std::bernoulli_distribution write(result.writeRatio);
+			std::vector<float> local;
+			std::uint64_t done = 0;
+			std::uint64_t written = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				int key = pick(rng);
+				bool isWrite = write(rng);
+				bool sampled = done % SAMPLE_EVERY == 0;
+				Clock::time_point start;
+				if (sampled)
+					start = Clock::now();
+				if (isWrite)
+					toggle(engine, key);
+				else
+					doNotOptimize(engine.contains(key));
+				if (sampled)
+					local.push_back(std::chrono::duration<float, std::nano>(Clock::now() - start).count());
+				written += isWrite;
+				++done;
+			}
+			ops.fetch_add(done);
+			writes.fetch_add(written);
+			std::lock_guard<std::mutex> guard(samplesLock);
+			samples.insert(samples.end(), local.begin(), local.end());
+		});
+		result.ops = ops.load();
+		result.writes = writes.load();
+		if (samples.empty())
+			return;
+		std::sort(samples.begin(), samples.end());
+		auto rank = [&](double quantile) {
+			return double(samples[std::min(samples.size() - 1, std::size_t(quantile * double(samples.size())))]);
+		};
+		result.p50 = rank(0.5);
+		result.p99 = rank(0.99);
+		result.p999 = rank(0.999);
+		result.max = double(samples.back());
+	}
+
+	// Thread 0 commits writes; threads 1..scanners scan the latest version
+	// end to end. Returns the seconds run.
+	double runScanPhase(MvccEngine& engine, unsigned scanners, const KeyPicker& picker, const Options& options,
+		std::uint64_t& commits, std::uint64_t& scans, int& peakVersions)
+	{
+		std::atomic<std::uint64_t> scanned{ 0 };
+		std::atomic<int> peak{ 0 };
+		double seconds = runThreads(scanners + 1, options.minTime, [&](unsigned index, const std::atomic<bool>& stop) {
+			std::mt19937_64 rng(splitmix64(options.seed + index));
+			KeyPicker pick = picker;
+			std::uint64_t done = 0;
+			if (index == 0)
+			{
+				int versions = 0;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					toggle(engine, pick(rng));
+					versions = std::max(versions, engine.versions().liveVersions());
+					++done;
+				}
+				commits = done;
+				peak.store(versions);
+				return;
+			}
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				MvccTree<int>::Handle handle = engine.versions().open();
+				long long sum = 0;
+				for (int key : handle)
+					sum += key;
+				doNotOptimize(sum);
+				++done;
+			}
+			scanned.fetch_add(done);
+		});
+		scans = scanned.load();
+		peakVersions = peak.load();
+		return seconds;
+	}
+
+	void runScans(Result& result, const Scenario& scenario, const Options& options)
+	{
+		MvccEngine engine;
+		prefill(engine, options.size, options.seed);
+		KeyPicker picker(scenario.distribution, 2 * options.size);
+		std::uint64_t commits = 0;
+		std::uint64_t scans = 0;
+		int versions = 0;
+		double seconds = runScanPhase(engine, 0, picker, options, commits, scans, versions);
+		result.baselineOpsPerSecond = double(commits) / seconds;
+		result.seconds = runScanPhase(engine, result.threads, picker, options, commits, result.scans, result.peakVersions);
+		result.ops = commits;
+		result.writes = commits;
+	}
+
+	const std::vector<Scenario>& scenarios()
+	{
+		static const std::vector<Scenario> list = {
+			{ "readers", "readers", 0.0 },
+			{ "mixed", "mixed/writes:5", 0.05 },
+			{ "mixed", "mixed/writes:50", 0.5 },
+			{ "mixed", "mixed/writes:95", 0.95 },
+			{ "skew", "skew:zipfian/writes:50", 0.5, Distribution::Zipfian },
+			{ "skew", "skew:hotspot/writes:50", 0.5, Distribution::Hotspot },
+			{ "scans", "scans", 1.0 },
+		};
+		return list;
+	}
+
+	std::string caseName(const Scenario& scenario, const std::string& engine, unsigned threads)
+	{
+		return "BM_" + scenario.label + "/" + engine + "/threads:" + std::to_string(threads);
+	}
+
+	template <class Engine>
+	Result runCase(const Scenario& scenario, const std::string& engine, unsigned threads, const Options& options)
+	{
+		Result result{ caseName(scenario, engine, threads), scenario.label, engine, threads, scenario.writeRatio };
+		if constexpr (std::is_same_v<Engine, MvccEngine>)
+			runScans(result, scenario, options);
+		else if (scenario.kind == "readers")
+			runReaders<Engine>(result, scenario, options);
+		else
+			runMixed<Engine>(result, scenario, options);
+		return result;
+	}
+
+	using Runner = std::function<Result(const Scenario&, unsigned, const Options&)>;
+
+	template <class Engine>
+	std::pair<std::string, Runner> engine(const std::string& name)
+	{
+		return { name, [name](const Scenario& s, unsigned t, const Options& o) { return runCase<Engine>(s, name, t, o); } };
+	}
+
+	const std::vector<std::pair<std::string, Runner>>& engines()
+	{
+		static const std::vector<std::pair<std::string, Runner>> list = {
+			engine<MutexTree>("mutex"),
+			engine<RcuTree<int>>("rcu"),
+			engine<OptimisticTree<int>>("optimistic"),
+			engine<LockFreeTree<int>>("lockfree"),
+			engine<ShardedTree<int>>("sharded"),
+			engine<MvccEngine>("mvcc"),
+		};
+		return list;
+	}
+
+	bool applies(const Scenario& scenario, const std::string& engine)
+	{
+		return (scenario.kind == "scans") == (engine == "mvcc");
+	}
+
+	void writeJson(std::ostream& out, const std::vector<Result>& results, const Options& options)
+	{
+		out << "{\n";
+		writeJsonContext(out, options.minTime, options.seed);
+		out << ",\n  \"size\": " << options.size << ",\n  \"benchmarks\": [";
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			out << (i == 0 ? "\n" : ",\n") << "    {\n";
+			out << "      \"name\": \"" << r.name << "\",\n";
+			out << "      \"scenario\": \"" << r.scenario << "\",\n";
+			out << "      \"engine\": \"" << r.engine << "\",\n";
+			out << "      \"threads\": " << r.threads << ",\n";
+			out << "      \"write_ratio\": " << r.writeRatio << ",\n";
+			out << "      \"seconds\": " << r.seconds << ",\n";
+			out << "      \"ops\": " << r.ops << ",\n";
+			out << "      \"writes\": " << r.writes << ",\n";
+			out << "      \"latency_ns\": { \"p50\": " << r.p50 << ", \"p99\": " << r.p99 << ", \"p99_9\": " << r.p999
+				<< ", \"max\": " << r.max << " },\n";
+			if (r.baselineOpsPerSecond != 0.0)
+			{
+				out << "      \"baseline_items_per_second\": " << r.baselineOpsPerSecond << ",\n";
+				out << "      \"scans\": " << r.scans << ",\n";
+				out << "      \"peak_versions\": " << r.peakVersions << ",\n";
+			}
+			out << "      \"items_per_second\": " << r.opsPerSecond() << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void writeCsv(std::ostream& out, const std::vector<Result>& results)
+	{
+		out << "name,scenario,engine,threads,write_ratio,seconds,ops,writes,items_per_second,p50_ns,p99_ns,p99_9_ns,max_ns,"
+			"baseline_items_per_second,scans,peak_versions\n";
+		for (const Result& r : results)
+			out << r.name << ',' << r.scenario << ',' << r.engine << ',' << r.threads << ',' << r.writeRatio << ','
+				<< r.seconds << ',' << r.ops << ',' << r.writes << ',' << r.opsPerSecond() << ','
+				<< r.p50 << ',' << r.p99 << ',' << r.p999 << ',' << r.max << ','
+				<< r.baselineOpsPerSecond << ',' << r.scans << ',' << r.peakVersions << '\n';
+	}
+
+	void printRow(std::FILE* table, const Result& r)
+	{
+		std::fprintf(table, "%-48s %14.0f ops/s %12llu writes", r.name.c_str(), r.opsPerSecond(),
+			static_cast<unsigned long long>(r.writes));
+		if (r.max != 0.0)
+			std::fprintf(table, "   p99 %10.0f ns   p99.9 %10.0f ns   max %12.0f ns", r.p99, r.p999, r.max);
+		if (r.baselineOpsPerSecond != 0.0)
+			std::fprintf(table, "   %.0f ops/s with no scanners, %llu scans, %d versions at most", r.baselineOpsPerSecond,
+				static_cast<unsigned long long>(r.scans), r.peakVersions);
+		std::fprintf(table, "\n");
+		std::fflush(table);
+	}
+
+	bool parseArgument(const std::string& arg, Options& options)
+	{
+		std::size_t eq = arg.find('=');
+		if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+			return false;
+		std::string key = arg.substr(2, eq - 2);
+		std::string value = arg.substr(eq + 1);
+		if (key == "min-time")
+			options.minTime = std::atof(value.c_str());
+		else if (key == "size")
+			options.size = std::size_t(std::atof(value.c_str()));
+		else if (key == "max-threads")
+			options.maxThreads = unsigned(std::atoi(value.c_str()));
+		else if (key == "seed")
+			options.seed = std::strtoull(value.c_str(), nullptr, 10);
+		else if (key == "filter")
+			options.filter = value;
+		else if (key == "format" && (value == "console" || value == "json" || value == "csv"))
+			options.format = value;
+		else if (key == "out")
+			options.out = value;
+		else
+			return false;
+		return options.size != 0 && options.maxThreads != 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!bench::parseArgument(argv[i], options))
+		{
+			std::cerr << "usage: " << argv[0] << " [--min-time=s] [--size=n] [--max-threads=n] [--seed=n]"
+				" [--filter=substring] [--format=console|json|csv] [--out=file]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The table goes to stderr when stdout carries the JSON or CSV.
+	std::FILE* table = options.format != "console" && options.out.empty() ? stderr : stdout;
+	std::vector<bench::Result> results;
+	for (const bench::Scenario& scenario : bench::scenarios())
+		for (const auto& [engine, run] : bench::engines())
+			for (unsigned threads = 1; threads <= options.maxThreads; threads *= 2)
+			{
+				std::string name = bench::caseName(scenario, engine, threads);
+				if (!bench::applies(scenario, engine))
+					continue;
+				if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+					continue;
+				results.push_back(run(scenario, threads, options));
+				bench::printRow(table, results.back());
+			}
+
+	if (options.format == "console")
+		return 0;
+	std::ofstream file;
+	if (!options.out.empty())
+	{
+		file.open(options.out);
+		if (!file)
+		{
+			std::cerr << "Cannot open " << options.out << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = options.out.empty() ? std::cout : file;
+	if (options.format == "json")
+		bench::writeJson(out, results, options);
+	else
+		bench::writeCsv(out, results);
+	return 0;
+}
@@ -0,0 +1,267 @@
+// Mateusz Kawa
+
+// Lookup cost of DiskTree as its working set outgrows the buffer pool. The
+// tree is built once in a temporary file; every case reopens it with a pool
+// of (file pages / ratio) frames, so a ratio of 0.1 caches the whole file ten
+// times over and a ratio of 10 caches a tenth of it. After one untimed pass
+// to reach a steady state, lookups of random keys repeat for --min-time
+// seconds. Uniform keys touch the whole file; zipfian keys (YCSB, theta
+// 0.99, scattered over the key space) have a hot set the pool can keep.
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -pthread -I.. DiskTreeBench.cpp -o disk
+//   ./disk --size=1e7 --format=json --out=disk.json
+//
+// A pool miss is one pread, which the OS page cache serves whenever the file
+// fits in memory; misses per lookup are reported alongside the time so that
+// runs on different devices can be compared. Make --size large enough for
+// the file to exceed the free memory to time the device itself.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BenchSupport.h"
+#include "DiskTree.h"
+
+namespace bench
+{
+	using Tree = disk::DiskTree<std::int64_t>;
+
+	// Lookups between two looks at the clock.
+	constexpr std::size_t BATCH = 4096;
+
+	constexpr double RATIOS[] = { 0.1, 0.2, 0.5, 1.0, 2.0, 5.0, 10.0 };
+
+	struct Options
+	{
+		double minTime = 0.5;
+		std::size_t size = 1'000'000;
+		std::uint64_t seed = 42;
+		std::string filter;
+		std::string format = "console";
+		std::string out;
+	};
+
+	struct Result
+	{
+		std::string name;
+		std::string distribution;
+		double ratio = 0.0;
+		std::size_t poolPages = 0;
+		std::size_t filePages = 0;
+		std::uint64_t lookups = 0;
+		std::uint64_t misses = 0;
+		double seconds = 0.0;
+
+		double nsPerLookup() const { return lookups == 0 ? 0.0 : seconds * 1e9 / double(lookups); }
+		double missesPerLookup() const { return lookups == 0 ? 0.0 : double(misses) / double(lookups); }
+	};
+
+	std::vector<std::int64_t> lookupKeys(const std::string& distribution, const Options& options)
+	{
+		std::vector<std::int64_t> keys(std::max<std::size_t>(options.size, BATCH));
+		std::mt19937_64 rng(options.seed ^ 0x5EA5C4ull);
+		if (distribution == "zipfian")
+		{
+			Zipfian zipf(options.size);
+			for (std::int64_t& key : keys)
+				key = std::int64_t(splitmix64(zipf(rng)) % options.size);
+		}
+		else
+		{
+			std::uniform_int_distribution<std::size_t> pick(0, options.size - 1);
+			for (std::int64_t& key : keys)
+				key = std::int64_t(pick(rng));
+		}
+		return keys;
+	}
+
+	bool build(const std::string& path, const Options& options)
+	{
+		std::vector<std::int64_t> keys(options.size);
+		for (std::size_t i = 0; i < keys.size(); ++i)
+			keys[i] = std::int64_t(i);
+		std::mt19937_64 rng(options.seed);
+		std::shuffle(keys.begin(), keys.end(), rng);
+		std::filesystem::remove(path);
+		Tree tree;
+		if (!tree.open(path, Tree::DEFAULT_POOL_PAGES * 16))
+			return false;
+		for (std::int64_t key : keys)
+			if (!tree.insert(key))
+				return false;
+		return tree.close();
+	}
+
+	Result runCase(const std::string& path, const std::string& distribution, double ratio,
+		const std::vector<std::int64_t>& keys, const Options& options)
+	{
+		Result result;
+		result.distribution = distribution;
+		result.ratio = ratio;
+		result.filePages = std::size_t(std::filesystem::file_size(path) / disk::PAGE_SIZE);
+		result.poolPages = std::max<std::size_t>(std::size_t(double(result.filePages) / ratio), 8);
+		char name[96];
+		std::snprintf(name, sizeof(name), "BM_diskSearch/%s/ratio:%g", distribution.c_str(), ratio);
+		result.name = name;
+
+		Tree tree;
+		if (!tree.open(path, result.poolPages))
+		{
+			std::cerr << "Cannot open " << path << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		for (std::int64_t key : keys)
+			doNotOptimize(tree.search(key));
+		tree.resetPoolStats();
+
+		std::size_t next = 0;
+		Clock::time_point start = Clock::now();
+		while (result.seconds < options.minTime)
+		{
+			for (std::size_t i = 0; i < BATCH; ++i)
+			{
+				doNotOptimize(tree.search(keys[next]));
+				next = next + 1 == keys.size() ? 0 : next + 1;
+			}
+			result.lookups += BATCH;
+			result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		result.misses = tree.poolStats().misses;
+		if (!tree.good())
+		{
+			std::cerr << "Reading " << path << " failed" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		return result;
+	}
+
+	void writeJson(std::ostream& out, const std::vector<Result>& results, const Options& options)
+	{
+		out << "{\n";
+		writeJsonContext(out, options.minTime, options.seed);
+		out << ",\n  \"size\": " << options.size << ",\n  \"benchmarks\": [";
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results[i];
+			out << (i == 0 ? "\n" : ",\n") << "    {\n";
+			out << "      \"name\": \"" << r.name << "\",\n";
+			out << "      \"distribution\": \"" << r.distribution << "\",\n";
+			out << "      \"working_set_to_ram\": " << r.ratio << ",\n";
+			out << "      \"pool_pages\": " << r.poolPages << ",\n";
+			out << "      \"file_pages\": " << r.filePages << ",\n";
+			out << "      \"lookups\": " << r.lookups << ",\n";
+			out << "      \"seconds\": " << r.seconds << ",\n";
+			out << "      \"ns_per_lookup\": " << r.nsPerLookup() << ",\n";
+			out << "      \"misses_per_lookup\": " << r.missesPerLookup() << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void writeCsv(std::ostream& out, const std::vector<Result>& results)
+	{
+		out << "name,distribution,working_set_to_ram,pool_pages,file_pages,lookups,seconds,ns_per_lookup,misses_per_lookup\n";
+		for (const Result& r : results)
+			out << r.name << ',' << r.distribution << ',' << r.ratio << ',' << r.poolPages << ',' << r.filePages << ','
+				<< r.lookups << ',' << r.seconds << ',' << r.nsPerLookup() << ',' << r.missesPerLookup() << '\n';
+	}
+
+	void printRow(std::FILE* table, const Result& r)
+	{
+		std::fprintf(table, "%-40s %10zu pages %12.0f ns/lookup %8.3f misses/lookup\n", r.name.c_str(), r.poolPages,
+			r.nsPerLookup(), r.missesPerLookup());
+		std::fflush(table);
+	}
+
+	bool parseArgument(const std::string& arg, Options& options)
+	{
+		std::size_t eq = arg.find('=');
+		if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+			return false;
+		std::string key = arg.substr(2, eq - 2);
+		std::string value = arg.substr(eq + 1);
+		if (key == "min-time")
+			options.minTime = std::atof(value.c_str());
+		else if (key == "size")
+			options.size = std::size_t(std::atof(value.c_str()));
+		else if (key == "seed")
+			options.seed = std::strtoull(value.c_str(), nullptr, 10);
+		else if (key == "filter")
+			options.filter = value;
+		else if (key == "format" && (value == "console" || value == "json" || value == "csv"))
+			options.format = value;
+		else if (key == "out")
+			options.out = value;
+		else
+			return false;
+		return options.size != 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!bench::parseArgument(argv[i], options))
+		{
+			std::cerr << "usage: " << argv[0] << " [--min-time=s] [--size=n] [--seed=n] [--filter=substring]"
+				" [--format=console|json|csv] [--out=file]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::string path = (std::filesystem::temp_directory_path() / "DiskTreeBench.bstd").string();
+	if (!bench::build(path, options))
+	{
+		std::cerr << "Cannot build " << path << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The table goes to stderr when stdout carries the JSON or CSV.
+	std::FILE* table = options.format != "console" && options.out.empty() ? stderr : stdout;
+	std::vector<bench::Result> results;
+	for (const char* distribution : { "uniform", "zipfian" })
+	{
+		std::vector<std::int64_t> keys;
+		for (double ratio : bench::RATIOS)
+		{
+			char name[96];
+			std::snprintf(name, sizeof(name), "BM_diskSearch/%s/ratio:%g", distribution, ratio);
+			if (!options.filter.empty() && std::string(name).find(options.filter) == std::string::npos)
+				continue;
+			if (keys.empty())
+				keys = bench::lookupKeys(distribution, options);
+			results.push_back(bench::runCase(path, distribution, ratio, keys, options));
+			bench::printRow(table, results.back());
+		}
+	}
+	std::filesystem::remove(path);
+
+	if (options.format == "console")
+		return 0;
+	std::ofstream file;
+	if (!options.out.empty())
+	{
+		file.open(options.out);
+		if (!file)
+		{
+			std::cerr << "Cannot open " << options.out << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = options.out.empty() ? std::cout : file;
+	if (options.format == "json")
+		bench::writeJson(out, results, options);
+	else
+		bench::writeCsv(out, results);
+	return 0;
+}
@@ -0,0 +1,551 @@
+// Mateusz Kawa
+
+// Microbenchmarks for the engines and tools built around BinaryTree, run
+// by the same case runner as BinaryTreeBench.cpp (see BenchCases.h) and
+// reported in the same formats, so that their numbers line up with those
+// of BinaryTree itself.
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -pthread -I.. EngineBench.cpp -o engines
+//   ./engines --max-size=1e6 --format=json --out=engines.json
+//
+// searchCoroN resolves random lookups as coroutines with N lookups
+// interleaved, in chunks of 256 keys; compare N across a tree much larger
+// than the last-level cache to find the useful interleave depth, and with
+// search and searchBatch in BinaryTreeBench.
+//
+// frozenScalar, frozenSse4 and frozenAvx2 answer the queries as lower
+// bounds on a FrozenTree snapshot with that kernel forced (a kernel the CPU
+// lacks is skipped); the Float variants do the same with float keys.
+// lowerBound is std::lower_bound over the sorted keys, for reference.
+//
+// mappedWarm and mappedCold look the queries up in a MappedTree written to
+// a temporary file. mappedWarm maps the file once and touches every key
+// before timing. mappedCold evicts the file from the page cache (on Linux;
+// elsewhere it only unmaps it), maps it afresh and times the first 1024
+// lookups, so every item is a lookup that may have to fault its pages in.
+//
+// stringInsertUrl and stringSearchUrl build and search a StringTree of n
+// URL-like keys; every one starts with "https://", so the eight-byte prefix
+// the tree compares first never decides and each comparison reaches memcmp.
+// stringInsertUuid and stringSearchUuid do the same with random UUID-like
+// keys, which the prefix almost always tells apart. The stdString variants
+// run the same keys through BinaryTree<std::string> for comparison.
+//
+// treeMapInsertV, treeMapFindV and treeMapIterateV fill a BinaryTreeMap of
+// int to V in uniform order, look the queries up reading the first word of
+// each value found, and walk the map in order reading every value, for V an
+// 8-byte and a 256-byte value. The stdMap variants do the same with
+// std::map.
+//
+// export writes every key in order through BufferedWriter into a temporary
+// file; exportStream does the same through an std::ostream, the way
+// inorder() prints. Run them with --max-size=1e7 --filter=xport for the
+// 10M-key export.
+//
+// reduceParallelN sums the keys with parallel_reduce and forEachParallelN
+// touches every key with parallel_for_each on N threads, over a balanced
+// tree built from the sorted keys, whose nodes therefore lie in key order in
+// memory; N = 1 is the baseline for their scaling.
+//
+// persistentInsert fills a PersistentTree the way insert in BinaryTreeBench
+// fills a BinaryTree, from the same keys, so the two compare directly.
+// persistentInsertSnapshots does the same while taking a snapshot every
+// 1024 inserts and keeping the last 16 alive, so that the paths the inserts
+// replace are shared and stay allocated instead of being freed.
+// persistentSnapshot takes 65536 snapshots of an n-key tree and drops them.
+//
+// ingestN writes n random 64-bit keys, one per line, to a temporary text
+// file (about 20 bytes a key, so --max-size=1e8 makes a 2 GB file) and
+// times ingest::loadTree of it into a BinaryTree<std::int64_t> on a pool of
+// N threads: parsing, sorting, merging and the balanced build. The file
+// was just written, so it is read from the page cache and the figure is
+// the CPU side of the ingest; it reports the file's MB/s, for N doubling
+// from 1 to --max-threads. The aim is 1 GB/s on 16 cores.
+//
+// Only the lookup ops run on the zipfian distribution; the string, map,
+// parallel, persistent and ingest ops run on the uniform distribution only (a
+// persistent insert into a list copies the whole list).
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BenchCases.h"
+#include "BinaryTree.h"
+#include "BinaryTreeMap.h"
+#include "CoroutineSearch.h"
+#include "FrozenTree.h"
+#include "KeyFileLoader.h"
+#include "MappedTree.h"
+#include "ParallelTree.h"
+#include "PersistentTree.h"
+#include "StringTree.h"
+#include "ThreadPool.h"
+#include "TreeWriter.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+	using Tree = BinaryTree<int>;
+
+	// Keys per interleaved batch, about what one request resolves.
+	constexpr std::size_t SEARCH_CHUNK = 256;
+
+	// Lookups timed per mappedCold iteration, right after the file is mapped.
+	constexpr std::size_t COLD_QUERIES = 1024;
+
+	// Inserts between two snapshots of persistentInsertSnapshots, snapshots
+	// it keeps alive, and snapshots taken per persistentSnapshot iteration.
+	constexpr std::size_t SNAPSHOT_EVERY = 1024;
+	constexpr std::size_t SNAPSHOTS_KEPT = 16;
+	constexpr std::size_t SNAPSHOTS_TAKEN = 1 << 16;
+
+	frozen::Kernel frozenKernel(const std::string& op)
+	{
+		if (op.rfind("frozenSse4", 0) == 0)
+			return frozen::Kernel::SSE4;
+		if (op.rfind("frozenAvx2", 0) == 0)
+			return frozen::Kernel::AVX2;
+		return frozen::Kernel::Scalar;
+	}
+
+	template <class K>
+	void runFrozen(Result& result, Tree& tree, const std::vector<int>& queries, const Options& options)
+	{
+		std::vector<K> sorted;
+		sorted.reserve(std::size_t(tree.size()));
+		tree.visitInorder([&](int key) { sorted.push_back(K(key)); });
+		std::vector<K> probes(queries.begin(), queries.end());
+		if (result.op == "lowerBound")
+		{
+			runTimed(result, options.minTime, probes.size(), [&](double& cpu) {
+				return timed(cpu, [&] {
+					for (K key : probes)
+						doNotOptimize(std::lower_bound(sorted.begin(), sorted.end(), key));
+				});
+			});
+			return;
+		}
+		frozen::FrozenTree<K> snapshot(sorted.data(), sorted.size());
+		snapshot.setKernel(frozenKernel(result.op));
+		runTimed(result, options.minTime, probes.size(), [&](double& cpu) {
+			return timed(cpu, [&] {
+				for (K key : probes)
+					doNotOptimize(snapshot.lower_bound(key));
+			});
+		});
+	}
+
+	// Key i of a URL-like set: eight hosts and six sections in front of a
+	// number, so keys share long prefixes.
+	std::string urlKey(std::size_t i)
+	{
+		static const char* const HOSTS[] = { "www", "shop", "blog", "api", "cdn", "docs", "news", "mail" };
+		static const char* const SECTIONS[] = { "products", "articles", "users", "search", "static/img", "help" };
+		std::uint64_t id = splitmix64(i);
+		char key[96];
+		std::snprintf(key, sizeof(key), "https://%s.example.com/%s/%llu", HOSTS[id % 8], SECTIONS[splitmix64(id) % 6],
+			static_cast<unsigned long long>(id >> 3));
+		return key;
+	}
+
+	// Key i of a set of random (version 4) UUIDs.
+	std::string uuidKey(std::size_t i)
+	{
+		std::uint64_t high = splitmix64(i);
+		std::uint64_t low = splitmix64(~i);
+		char key[40];
+		std::snprintf(key, sizeof(key), "%08llx-%04llx-4%03llx-%04llx-%012llx", static_cast<unsigned long long>(high >> 32),
+			static_cast<unsigned long long>((high >> 16) & 0xFFFF), static_cast<unsigned long long>(high & 0xFFF),
+			static_cast<unsigned long long>(((low >> 48) & 0x3FFF) | 0x8000), static_cast<unsigned long long>(low & 0xFFFFFFFFFFFFull));
+		return key;
+	}
+
+	bool stringOp(const std::string& op)
+	{
+		return op.rfind("string", 0) == 0 || op.rfind("stdString", 0) == 0;
+	}
+
+	// Inserts strings in the given order, or searches for the queried ones.
+	template <class StringSet>
+	void runStrings(Result& result, const std::vector<std::string>& strings, const std::vector<int>& order,
+		const std::vector<int>& queries, const Options& options)
+	{
+		if (result.op.find("Insert") != std::string::npos)
+		{
+			runTimed(result, options.minTime, order.size(), [&](double& cpu) {
+				StringSet tree;
+				double real = timed(cpu, [&] {
+					for (int i : order)
+						tree.insert(strings[i]);
+				});
+				result.depth = tree.depth();
+				return real;
+			});
+			return;
+		}
+		StringSet tree;
+		for (int i : order)
+			tree.insert(strings[i]);
+		result.depth = tree.depth();
+		runTimed(result, options.minTime, queries.size(), [&](double& cpu) {
+			return timed(cpu, [&] {
+				for (int i : queries)
+					doNotOptimize(tree.search(strings[i]));
+			});
+		});
+	}
+
+	bool mapOp(const std::string& op)
+	{
+		return op.rfind("treeMap", 0) == 0 || op.rfind("stdMap", 0) == 0;
+	}
+
+	// Map maps int to V, an array of words; lookups read the first word.
+	template <class Map, class V>
+	void runMap(Result& result, const std::vector<int>& order, const std::vector<int>& queries, const Options& options)
+	{
+		auto fill = [&](Map& map) {
+			for (int key : order)
+				map.try_emplace(key, V{ { std::uint64_t(key) } });
+		};
+		if (result.op.find("Insert") != std::string::npos)
+		{
+			runTimed(result, options.minTime, order.size(), [&](double& cpu) {
+				Map map;
+				return timed(cpu, [&] { fill(map); });
+			});
+			return;
+		}
+		Map map;
+		fill(map);
+		bool find = result.op.find("Find") != std::string::npos;
+		runTimed(result, options.minTime, find ? queries.size() : order.size(), [&](double& cpu) {
+			return timed(cpu, [&] {
+				std::uint64_t sum = 0;
+				if (find)
+					for (int key : queries)
+						sum += (*map.find(key)).second[0];
+				else
+					for (auto it = map.begin(); it != map.end(); ++it)
+						sum += (*it).second[0];
+				doNotOptimize(sum);
+			});
+		});
+	}
+
+	template <class V>
+	void runMapValue(Result& result, const std::vector<int>& order, const std::vector<int>& queries, const Options& options)
+	{
+		if (result.op.rfind("std", 0) == 0)
+			runMap<std::map<int, V>, V>(result, order, queries, options);
+		else
+			runMap<BinaryTreeMap<int, V>, V>(result, order, queries, options);
+	}
+
+	// Drops the pages of path from the page cache, so that the next mapping
+	// reads them from the disk. Only Linux can do this for a single file.
+	void evictFromCache(const std::string& path)
+	{
+#ifdef __linux__
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		::fdatasync(fd);
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+#else
+		(void)path;
+#endif
+	}
+
+	void runMapped(Result& result, Tree& tree, const std::vector<int>& queries, const Options& options)
+	{
+		std::string path = (std::filesystem::temp_directory_path()
+			/ ("EngineBench." + std::to_string(result.size) + ".bste")).string();
+		if (!mapped::write(path, tree))
+		{
+			std::cerr << "Cannot write " << path << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		if (result.op == "mappedWarm")
+		{
+			mapped::MappedTree<int> snapshot(path);
+			tree.visitInorder([&](int key) { doNotOptimize(snapshot.contains(key)); });
+			runTimed(result, options.minTime, queries.size(), [&](double& cpu) {
+				return timed(cpu, [&] {
+					for (int key : queries)
+						doNotOptimize(snapshot.contains(key));
+				});
+			});
+		}
+		else
+		{
+			std::size_t count = std::min(queries.size(), COLD_QUERIES);
+			runTimed(result, options.minTime, count, [&](double& cpu) {
+				evictFromCache(path);
+				mapped::MappedTree<int> snapshot(path);
+				return timed(cpu, [&] {
+					for (std::size_t i = 0; i < count; ++i)
+						doNotOptimize(snapshot.contains(queries[i]));
+				});
+			});
+		}
+		std::filesystem::remove(path);
+	}
+
+	void runIngest(Result& result, std::size_t threads, const Options& options)
+	{
+		std::string path = (std::filesystem::temp_directory_path()
+			/ ("EngineBench." + std::to_string(result.size) + ".keys")).string();
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+		{
+			std::cerr << "Cannot write " << path << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		{
+			BufferedWriter writer(file, '\n');
+			std::mt19937_64 rng(options.seed);
+			for (std::size_t i = 0; i < result.size; ++i)
+				writer(std::int64_t(rng()));
+			if (!writer.flush())
+			{
+				std::cerr << "Cannot write " << path << std::endl;
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		std::fclose(file);
+		result.fileBytes = std::size_t(std::filesystem::file_size(path));
+
+		tasks::ThreadPool pool(threads);
+		runTimed(result, options.minTime, result.size, [&](double& cpu) {
+			BinaryTree<std::int64_t> tree;
+			bool loaded = false;
+			double real = timed(cpu, [&] { loaded = ingest::loadTree(tree, path, pool); });
+			if (!loaded || tree.size() != int(result.size))
+			{
+				std::cerr << "Cannot ingest " << path << std::endl;
+				std::exit(EXIT_FAILURE);
+			}
+			result.depth = tree.depth();
+			return real;
+		});
+		std::filesystem::remove(path);
+	}
+
+	bool lookupOp(const std::string& op)
+	{
+		return op.rfind("searchCoro", 0) == 0 || op.rfind("frozen", 0) == 0 || op.rfind("mapped", 0) == 0
+			|| op == "lowerBound";
+	}
+
+	bool applies(const std::string& op, Distribution distribution, std::size_t n, const Options& options)
+	{
+		if (degenerate(distribution) && n > options.maxDegenerate)
+			return false;
+		if (op.rfind("frozen", 0) == 0 && !frozen::kernelSupported(frozenKernel(op)))
+			return false;
+		if (lookupOp(op))
+			return true;
+		if (stringOp(op) || mapOp(op) || op.find("Parallel") != std::string::npos
+			|| op.rfind("persistent", 0) == 0 || op.rfind("ingest", 0) == 0)
+			return distribution == Distribution::Uniform;
+		return distribution != Distribution::Zipfian;
+	}
+
+	Result runCase(const std::string& op, Distribution distribution, std::size_t n, const Options& options)
+	{
+		Result result{ "BM_" + op + "/" + distributionName(distribution) + "/" + std::to_string(n), op, distribution, n };
+		std::vector<int> keys = insertionOrder(distribution, n, options.seed);
+
+		if (op.rfind("reduceParallel", 0) == 0 || op.rfind("forEachParallel", 0) == 0)
+		{
+			bool reduce = op.rfind("reduce", 0) == 0;
+			std::sort(keys.begin(), keys.end());
+			Tree tree;
+			tree.buildFromSorted(keys.begin(), keys.end());
+			result.depth = tree.depth();
+			tasks::ThreadPool pool(std::size_t(std::atoi(op.c_str() + (reduce ? 14 : 15))));
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				return timed(cpu, [&] {
+					if (reduce)
+						doNotOptimize(tasks::parallel_reduce(tree, 0LL, [](long long a, long long b) { return a + b; }, pool));
+					else
+					{
+						std::atomic<long long> touched{ 0 };
+						tasks::parallel_for_each(tree, [&](const int& key) {
+							if (key == 0)
+								touched.fetch_add(1, std::memory_order_relaxed);
+						}, pool);
+						doNotOptimize(touched.load());
+					}
+				});
+			});
+			return result;
+		}
+		if (op.rfind("ingest", 0) == 0)
+		{
+			runIngest(result, std::size_t(std::atoi(op.c_str() + 6)), options);
+			return result;
+		}
+		if (op.rfind("persistent", 0) == 0)
+		{
+			if (op == "persistentSnapshot")
+			{
+				PersistentTree<int> tree;
+				for (int key : keys)
+					tree.insert(key);
+				result.depth = tree.depth();
+				std::vector<PersistentTree<int>> snapshots;
+				snapshots.reserve(SNAPSHOTS_TAKEN);
+				runTimed(result, options.minTime, SNAPSHOTS_TAKEN, [&](double& cpu) {
+					return timed(cpu, [&] {
+						for (std::size_t i = 0; i < SNAPSHOTS_TAKEN; ++i)
+							snapshots.push_back(tree.snapshot());
+						snapshots.clear();
+					});
+				});
+				return result;
+			}
+			bool snapshotting = op == "persistentInsertSnapshots";
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				PersistentTree<int> tree;
+				std::vector<PersistentTree<int>> snapshots(SNAPSHOTS_KEPT);
+				double real = timed(cpu, [&] {
+					for (std::size_t i = 0; i < n; ++i)
+					{
+						tree.insert(keys[i]);
+						if (snapshotting && i % SNAPSHOT_EVERY == 0)
+							snapshots[i / SNAPSHOT_EVERY % SNAPSHOTS_KEPT] = tree.snapshot();
+					}
+				});
+				result.depth = tree.depth();
+				return real;
+			});
+			return result;
+		}
+		if (stringOp(op))
+		{
+			std::vector<std::string> strings(n);
+			for (std::size_t i = 0; i < n; ++i)
+				strings[i] = op.find("Uuid") != std::string::npos ? uuidKey(i) : urlKey(i);
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			if (op.rfind("std", 0) == 0)
+				runStrings<BinaryTree<std::string>>(result, strings, keys, queries, options);
+			else
+				runStrings<StringTree>(result, strings, keys, queries, options);
+			return result;
+		}
+		if (mapOp(op))
+		{
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			if (op.find("256") != std::string::npos)
+				runMapValue<std::array<std::uint64_t, 32>>(result, keys, queries, options);
+			else
+				runMapValue<std::array<std::uint64_t, 1>>(result, keys, queries, options);
+			return result;
+		}
+
+		Tree tree;
+		build(tree, keys);
+		result.depth = tree.depth();
+
+		if (op.rfind("searchCoro", 0) == 0)
+		{
+			std::size_t depth = std::size_t(std::atoi(op.c_str() + 10));
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			std::vector<Tree::node_ptr> found(queries.size());
+			runTimed(result, options.minTime, queries.size(), [&](double& cpu) {
+				return timed(cpu, [&] {
+					for (std::size_t first = 0; first < queries.size(); first += SEARCH_CHUNK)
+					{
+						std::size_t count = std::min(SEARCH_CHUNK, queries.size() - first);
+						coro::interleavedSearch(tree, std::span<const int>(queries.data() + first, count),
+							std::span<Tree::node_ptr>(found.data() + first, count), depth);
+					}
+					doNotOptimize(found.back());
+				});
+			});
+		}
+		else if (op.rfind("frozen", 0) == 0 || op == "lowerBound")
+		{
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			if (op.find("Float") != std::string::npos)
+				runFrozen<float>(result, tree, queries, options);
+			else
+				runFrozen<int>(result, tree, queries, options);
+		}
+		else if (op.rfind("mapped", 0) == 0)
+		{
+			std::vector<int> queries = lookupKeys(distribution, n, std::min(n, options.queries), options.seed);
+			runMapped(result, tree, queries, options);
+		}
+		else if (op == "export" || op == "exportStream")
+		{
+			runTimed(result, options.minTime, n, [&](double& cpu) {
+				std::FILE* file = std::tmpfile();
+				if (file == nullptr)
+				{
+					std::cerr << "Cannot create a temporary file" << std::endl;
+					std::exit(EXIT_FAILURE);
+				}
+				double real = timed(cpu, [&] {
+					if (op == "export")
+					{
+						BufferedWriter writer(file, '\n');
+						tree.visitInorder(writer);
+						if (!writer.flush())
+							std::cerr << "Export write failed" << std::endl;
+					}
+					else
+					{
+						std::ostringstream text;
+						tree.visitInorder([&](int key) { text << key << '\n'; });
+						std::string bytes = text.str();
+						std::fwrite(bytes.data(), 1, bytes.size(), file);
+					}
+					std::fflush(file);
+				});
+				std::fclose(file);
+				return real;
+			});
+		}
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Options options;
+	if (!bench::parseArguments(argc, argv, options))
+		return EXIT_FAILURE;
+
+	std::vector<std::string> ops = { "searchCoro1", "searchCoro4", "searchCoro8", "searchCoro16", "searchCoro32",
+		"searchCoro64", "lowerBound", "frozenScalar", "frozenSse4", "frozenAvx2", "frozenScalarFloat", "frozenSse4Float",
+		"frozenAvx2Float", "mappedWarm", "mappedCold", "export", "exportStream", "stringInsertUrl", "stringSearchUrl",
+		"stringInsertUuid", "stringSearchUuid", "stdStringInsertUrl", "stdStringSearchUrl", "stdStringInsertUuid",
+		"stdStringSearchUuid", "treeMapInsert8", "treeMapFind8", "treeMapIterate8", "treeMapInsert256",
+		"treeMapFind256", "treeMapIterate256", "stdMapInsert8", "stdMapFind8", "stdMapIterate8", "stdMapInsert256",
+		"stdMapFind256", "stdMapIterate256", "persistentInsert", "persistentInsertSnapshots", "persistentSnapshot" };
+	for (const char* parallel : { "reduceParallel", "forEachParallel", "ingest" })
+		for (unsigned threads = 1; threads <= options.maxThreads; threads *= 2)
+			ops.push_back(parallel + std::to_string(threads));
+	return bench::runCases(options, ops, bench::applies, bench::runCase);
+}
@@ -0,0 +1,268 @@
+// Mateusz Kawa
+
+// Replays a workload trace against the tree engines and prints how each
+// fared. Traces are read in the binary form of TraceFile.h or, failing
+// that, in its text form; keys are 64-bit integers.
+//
+//   g++ -std=c++20 -O2 -DNDEBUG -pthread -I.. TraceReplay.cpp -o replay
+//   ./replay --engine=all --format=json --out=report.json trace.bstr
+//   ./replay --anonymize --convert=anonymous.bstr production.txt
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "BinaryTree.h"
+#include "LockFreeTree.h"
+#include "OptimisticTree.h"
+#include "PersistentTree.h"
+#include "RcuTree.h"
+#include "TraceFile.h"
+#include "TraceReplay.h"
+
+namespace replay
+{
+	using Key = std::int64_t;
+	using Trace = std::vector<tracefile::Op<Key>>;
+
+	struct Options
+	{
+		std::string engine = "binary";
+		std::string format = "console";
+		std::string out;
+		std::string convert;
+		std::string trace;
+		bool anonymize = false;
+		tracereplay::Options replay;
+	};
+
+	struct Run
+	{
+		std::string engine;
+		tracereplay::Report report;
+	};
+
+	template <class Engine>
+	Run run(const std::string& name, const Trace& trace, const Options& options)
+	{
+		Engine engine;
+		return { name, tracereplay::replay(engine, std::span<const tracefile::Op<Key>>(trace), options.replay) };
+	}
+
+	const std::vector<std::pair<std::string, std::function<Run(const Trace&, const Options&)>>>& engines()
+	{
+		static const std::vector<std::pair<std::string, std::function<Run(const Trace&, const Options&)>>> list = {
+			{ "binary", [](const Trace& t, const Options& o) { return run<BinaryTree<Key>>("binary", t, o); } },
+			{ "persistent", [](const Trace& t, const Options& o) { return run<PersistentTree<Key>>("persistent", t, o); } },
+			{ "rcu", [](const Trace& t, const Options& o) { return run<RcuTree<Key>>("rcu", t, o); } },
+			{ "optimistic", [](const Trace& t, const Options& o) { return run<OptimisticTree<Key>>("optimistic", t, o); } },
+			{ "lockfree", [](const Trace& t, const Options& o) { return run<LockFreeTree<Key>>("lockfree", t, o); } },
+		};
+		return list;
+	}
+
+	bool loadTrace(const std::string& path, Trace& trace)
+	{
+		if (tracefile::load(path, trace))
+			return true;
+		std::size_t line = 0;
+		if (tracefile::loadText(path, trace, &line))
+			return true;
+		if (line != 0)
+			std::cerr << path << ":" << line << ": not a trace op" << std::endl;
+		else
+			std::cerr << "Cannot read " << path << std::endl;
+		return false;
+	}
+
+	void printConsole(std::ostream& out, const std::vector<Run>& runs)
+	{
+		for (const Run& run : runs)
+		{
+			const tracereplay::Report& r = run.report;
+			out << run.engine << ": " << r.ops << " ops in " << r.seconds * 1e3 << " ms, "
+				<< std::uint64_t(r.opsPerSecond()) << " ops/s, digest " << std::hex << r.digest << std::dec << "\n";
+			for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+			{
+				if (r.count[kind] == 0)
+					continue;
+				const tracereplay::Latency& l = r.latency[kind];
+				out << "  " << tracefile::kindName(tracefile::OpKind(kind + 1)) << ": " << r.count[kind] << " ops, "
+					<< r.hits[kind] << " hits";
+				if (r.unknown[kind] != 0)
+					out << " (" << r.unknown[kind] << " unknown)";
+				if (r.unsupported[kind] != 0)
+					out << ", " << r.unsupported[kind] << " unsupported";
+				else
+					out << ", p50 " << l.p50 << " / p99 " << l.p99 << " / p99.9 " << l.p999 << " / max " << l.max << " ns";
+				out << "\n";
+			}
+			out << "  size " << r.size << ", depth " << r.depth;
+			if (r.hasShape)
+				out << ", optimal " << r.shape.optimalHeight() << ", average depth " << r.shape.averageDepth()
+					<< ", leaves " << r.shape.leaves;
+			out << ", timer overhead " << r.timerOverhead << " ns\n";
+		}
+	}
+
+	void writeLatency(std::ostream& out, const tracereplay::Latency& l)
+	{
+		out << "{ \"samples\": " << l.samples << ", \"mean\": " << l.mean << ", \"p50\": " << l.p50 << ", \"p90\": " << l.p90
+			<< ", \"p99\": " << l.p99 << ", \"p99_9\": " << l.p999 << ", \"max\": " << l.max << " }";
+	}
+
+	void writeJson(std::ostream& out, const std::vector<Run>& runs, const Options& options)
+	{
+		out << "{\n  \"trace\": \"" << options.trace << "\",\n  \"runs\": [";
+		for (std::size_t i = 0; i < runs.size(); ++i)
+		{
+			const tracereplay::Report& r = runs[i].report;
+			out << (i == 0 ? "\n" : ",\n") << "    {\n      \"engine\": \"" << runs[i].engine << "\",\n";
+			out << "      \"ops\": " << r.ops << ",\n      \"seconds\": " << r.seconds << ",\n";
+			out << "      \"ops_per_second\": " << r.opsPerSecond() << ",\n";
+			out << "      \"digest\": \"" << std::hex << r.digest << std::dec << "\",\n";
+			out << "      \"timer_overhead_ns\": " << r.timerOverhead << ",\n";
+			out << "      \"latency_ns\": ";
+			writeLatency(out, r.overall);
+			out << ",\n      \"kinds\": {";
+			for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+			{
+				out << (kind == 0 ? "\n" : ",\n") << "        \"" << tracefile::kindName(tracefile::OpKind(kind + 1)) << "\": { \"count\": "
+					<< r.count[kind] << ", \"hits\": " << r.hits[kind] << ", \"unsupported\": " << r.unsupported[kind] << ", \"unknown\": " << r.unknown[kind] << ", \"latency_ns\": ";
+				writeLatency(out, r.latency[kind]);
+				out << " }";
+			}
+			out << "\n      },\n      \"shape\": { \"size\": " << r.size << ", \"depth\": " << r.depth;
+			if (r.hasShape)
+			{
+				out << ", \"optimal_depth\": " << r.shape.optimalHeight() << ", \"average_depth\": " << r.shape.averageDepth()
+					<< ", \"leaves\": " << r.shape.leaves << ", \"levels\": [";
+				for (std::size_t level = 0; level < r.shape.levels.size(); ++level)
+					out << (level == 0 ? "" : ", ") << r.shape.levels[level];
+				out << "]";
+			}
+			out << " }\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void writeCsv(std::ostream& out, const std::vector<Run>& runs)
+	{
+		out << "engine,kind,count,hits,unsupported,ops_per_second,mean_ns,p50_ns,p90_ns,p99_ns,p99_9_ns,max_ns,size,depth\n";
+		for (const Run& run : runs)
+		{
+			const tracereplay::Report& r = run.report;
+			auto row = [&](const char* kind, std::size_t count, std::size_t hits, std::size_t unsupported, const tracereplay::Latency& l) {
+				out << run.engine << ',' << kind << ',' << count << ',' << hits << ',' << unsupported << ',' << r.opsPerSecond() << ','
+					<< l.mean << ',' << l.p50 << ',' << l.p90 << ',' << l.p99 << ',' << l.p999 << ',' << l.max << ','
+					<< r.size << ',' << r.depth << '\n';
+			};
+			std::size_t unsupported = 0;
+			for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+				unsupported += r.unsupported[kind];
+			row("all", r.ops, 0, unsupported, r.overall);
+			for (std::size_t kind = 0; kind < tracefile::OP_KINDS; ++kind)
+				row(tracefile::kindName(tracefile::OpKind(kind + 1)), r.count[kind], r.hits[kind], r.unsupported[kind], r.latency[kind]);
+		}
+	}
+
+	bool parseArgument(const std::string& arg, Options& options)
+	{
+		if (arg == "--anonymize")
+		{
+			options.anonymize = true;
+			return true;
+		}
+		std::size_t eq = arg.find('=');
+		if (arg.rfind("--", 0) != 0)
+		{
+			options.trace = arg;
+			return true;
+		}
+		if (eq == std::string::npos)
+			return false;
+		std::string key = arg.substr(2, eq - 2);
+		std::string value = arg.substr(eq + 1);
+		if (key == "engine")
+			options.engine = value;
+		else if (key == "format" && (value == "console" || value == "json" || value == "csv"))
+			options.format = value;
+		else if (key == "out")
+			options.out = value;
+		else if (key == "convert")
+			options.convert = value;
+		else if (key == "sample")
+			options.replay.sampleEvery = std::size_t(std::atof(value.c_str()));
+		else
+			return false;
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	replay::Options options;
+	bool valid = argc > 1;
+	for (int i = 1; i < argc && valid; ++i)
+		valid = replay::parseArgument(argv[i], options);
+	if (!valid || options.trace.empty())
+	{
+		std::cerr << "usage: " << argv[0] << " [--engine=binary|persistent|rcu|optimistic|lockfree|all] [--sample=n]"
+			" [--format=console|json|csv] [--out=file] [--anonymize] [--convert=file.bstr] trace" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	replay::Trace trace;
+	if (!replay::loadTrace(options.trace, trace))
+		return EXIT_FAILURE;
+	if (options.anonymize)
+	{
+		std::vector<tracefile::Op<std::uint64_t>> ranked = tracefile::anonymize(trace);
+		for (std::size_t i = 0; i < trace.size(); ++i)
+			trace[i] = { ranked[i].kind, replay::Key(ranked[i].key), replay::Key(ranked[i].high) };
+	}
+	if (!options.convert.empty())
+	{
+		if (!tracefile::save(options.convert, trace))
+		{
+			std::cerr << "Cannot write " << options.convert << std::endl;
+			return EXIT_FAILURE;
+		}
+		return 0;
+	}
+
+	std::vector<replay::Run> runs;
+	for (const auto& [name, runEngine] : replay::engines())
+		if (options.engine == "all" || options.engine == name)
+			runs.push_back(runEngine(trace, options));
+	if (runs.empty())
+	{
+		std::cerr << "Unknown engine " << options.engine << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream file;
+	if (!options.out.empty())
+	{
+		file.open(options.out);
+		if (!file)
+		{
+			std::cerr << "Cannot open " << options.out << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = options.out.empty() ? std::cout : file;
+	if (options.format == "json")
+		replay::writeJson(out, runs, options);
+	else if (options.format == "csv")
+		replay::writeCsv(out, runs);
+	else
+		replay::printConsole(out, runs);
+	return 0;
+}
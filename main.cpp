@@ -169,6 +169,13 @@ int main()
         ImGui::Text(temp.c_str());
         temp = "Maximum: " + std::to_string(vbt.maximum());
         ImGui::Text(temp.c_str());
+        MemoryStats memory = vbt.memory_stats();
+        temp = "Memory: " + std::to_string(memory.reservedBytes()) + " B (" + std::to_string(memory.bytesPerNode()) + " B/node)";
+        ImGui::Text(temp.c_str());
+        temp = "In use: " + std::to_string(memory.bytesInUse()) + " B, overhead: " + std::to_string(memory.allocatorOverhead) + " B";
+        ImGui::Text(temp.c_str());
+        temp = "Fragmentation: " + std::to_string(int(memory.fragmentation() * 100.0 + 0.5)) + "%";
+        ImGui::Text(temp.c_str());
         ImGui::Text("Inorder:");
         ImGui::Text(vbt.inorder().c_str());
         ImGui::End();
@@ -0,0 +1,127 @@
+// Mateusz Kawa
+
+// Readers look up keys that never leave the tree while a writer removes the
+// keys between them. Each round the writer builds a fresh tree with the
+// churn keys inserted first, so they sit above the stable keys, publishes
+// it and removes every churn key. The successor of churn key k is stable
+// key k + 1, so most removals move a stable key up the tree; a reader that
+// ever misses one is a false negative and fails the run. Comparisons are
+// slowed down so that readers spend their time inside descents and get
+// preempted there even on a single core. There each grace period also waits
+// for every preempted reader to be scheduled again, so expect few rounds.
+//
+//   g++ -std=c++20 -O2 -pthread -I.. RcuTreeStress.cpp -o rcu_stress
+//   ./rcu_stress [seconds] [readers]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Epoch.h"
+#include "RcuTree.h"
+
+struct SlowKey
+{
+	int value;
+
+	static void delay()
+	{
+		volatile int sink = 0;
+		for (int spin = 0; spin < 64; ++spin)
+			sink = sink + spin;
+	}
+
+	friend bool operator<(const SlowKey& a, const SlowKey& b)
+	{
+		delay();
+		return a.value < b.value;
+	}
+
+	friend bool operator==(const SlowKey& a, const SlowKey& b)
+	{
+		return a.value == b.value;
+	}
+};
+
+using Tree = RcuTree<SlowKey>;
+
+constexpr int KEYS = 1 << 6;
+
+// Odd keys churn and go in first, even keys are stable.
+Tree* buildRound(std::mt19937& rng, std::vector<int>& churn)
+{
+	std::vector<int> stable;
+	churn.clear();
+	for (int key = 0; key < KEYS; ++key)
+		(key % 2 == 0 ? stable : churn).push_back(key);
+	std::shuffle(churn.begin(), churn.end(), rng);
+	std::shuffle(stable.begin(), stable.end(), rng);
+	Tree* tree = new Tree;
+	for (int key : churn)
+		tree->insert(SlowKey{ key });
+	for (int key : stable)
+		tree->insert(SlowKey{ key });
+	std::shuffle(churn.begin(), churn.end(), rng);
+	return tree;
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = argc > 1 ? std::atof(argv[1]) : 5.0;
+	int readers = argc > 2 ? std::atoi(argv[2]) : 4;
+
+	std::mt19937 rng(7);
+	std::vector<int> churn;
+	std::atomic<Tree*> current{ buildRound(rng, churn) };
+	std::atomic<bool> stop{ false };
+	std::atomic<std::uint64_t> lookups{ 0 };
+	std::atomic<std::uint64_t> misses{ 0 };
+	std::vector<std::thread> threads;
+	for (int r = 0; r < readers; ++r)
+		threads.emplace_back([&, r] {
+			std::mt19937 pickRng(r + 2);
+			std::uniform_int_distribution<int> pick(0, KEYS / 2 - 1);
+			std::uint64_t done = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				int key = 2 * pick(pickRng);
+				auto guard = epoch::pin();
+				if (current.load(std::memory_order_acquire)->search(SlowKey{ key }) == nullptr)
+				{
+					misses.fetch_add(1, std::memory_order_relaxed);
+					std::fprintf(stderr, "reader %d missed stable key %d\n", r, key);
+				}
+				++done;
+			}
+			lookups.fetch_add(done, std::memory_order_relaxed);
+		});
+
+	std::uint64_t rounds = 0;
+	std::uint64_t removals = 0;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		Tree* tree = current.load(std::memory_order_relaxed);
+		for (int key : churn)
+			removals += tree->remove(SlowKey{ key });
+		++rounds;
+		// Readers may still be inside the old tree; it goes once they are out.
+		epoch::retire(current.exchange(buildRound(rng, churn), std::memory_order_acq_rel));
+	}
+	stop.store(true);
+	for (std::thread& thread : threads)
+		thread.join();
+	delete current.load();
+	epoch::Domain::global().synchronize();
+
+	std::printf("%llu rounds, %llu removals, %llu lookups, %llu false negatives\n",
+		static_cast<unsigned long long>(rounds), static_cast<unsigned long long>(removals),
+		static_cast<unsigned long long>(lookups.load()), static_cast<unsigned long long>(misses.load()));
+	return misses.load() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+// Mateusz Kawa
+
+// StringTree against std::multiset on keys chosen to hit the arena and the
+// comparison edge cases: the empty key (also as the very first insert into
+// a fresh tree), keys that differ only past the inline prefix, prefixes of
+// each other, embedded zero bytes, and keys large enough to get a chunk of
+// their own.
+//
+//   g++ -std=c++20 -O2 -I.. StringTreeTest.cpp -o string_test
+//   ./string_test
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StringTree.h"
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::fprintf(stderr, "failed: %s\n", what);
+		++failures;
+	}
+}
+
+bool matches(const StringTree& tree, const std::multiset<std::string>& model)
+{
+	std::vector<std::string> keys;
+	for (std::string_view key : tree)
+		keys.emplace_back(key);
+	return tree.size() == int(model.size()) && std::equal(keys.begin(), keys.end(), model.begin(), model.end());
+}
+
+int main()
+{
+	{
+		StringTree tree;
+		tree.insert("");
+		check(tree.size() == 1 && tree.contains(""), "empty key as the first insert");
+		tree.insert("");
+		tree.insert("a");
+		check(tree.size() == 3 && tree.keyBytes() == 1, "empty key stores no bytes");
+		tree.clear();
+		tree.insert("");
+		check(tree.contains("") && !tree.contains("a"), "empty key after clear");
+	}
+
+	{
+		// A large key first, so that the arena has a chunk before any small one.
+		StringTree tree;
+		tree.insert(std::string(1 << 15, 'x'));
+		tree.insert("");
+		tree.insert("y");
+		check(tree.contains("") && tree.contains("y") && tree.contains(std::string(1 << 15, 'x')), "empty key after a large one");
+	}
+
+	StringTree tree;
+	std::multiset<std::string> model;
+	std::mt19937 rng(11);
+	const std::string stems[] = { "", "a", "abcdefgh", "abcdefghi", std::string("abcdefgh\0", 9), "https://example.com/" };
+	for (int i = 0; i < 20000; ++i)
+	{
+		std::string key(stems[rng() % std::size(stems)]);
+		int extra = int(rng() % 12);
+		for (int c = 0; c < extra; ++c)
+			key += char("ab\0z"[rng() % 4]);
+		if (rng() % 1000 == 0)
+			key.append(std::size_t(20000 + rng() % 10000), 'q');
+		tree.insert(key);
+		model.insert(key);
+	}
+	check(matches(tree, model), "inorder walk matches std::multiset");
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::string probe(stems[rng() % std::size(stems)]);
+		int extra = int(rng() % 12);
+		for (int c = 0; c < extra; ++c)
+			probe += char("ab\0z"[rng() % 4]);
+		check(tree.contains(probe) == (model.count(probe) != 0), "contains agrees with std::multiset");
+	}
+
+	if (failures == 0)
+		std::printf("all checks passed\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
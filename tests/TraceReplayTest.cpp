@@ -0,0 +1,128 @@
+// Mateusz Kawa
+
+// Replays small mixed traces of inserts, lookups, erases and ranges against
+// every engine the replay driver knows and checks that engines with the
+// same semantics agree on the digest: the four multisets on any trace, and
+// all five, LockFreeTree being a set, on a trace that never inserts a key
+// twice. Range hits are also checked against std::multiset and std::set.
+//
+//   g++ -std=c++20 -O2 -pthread -I.. TraceReplayTest.cpp -o replay_test
+//   ./replay_test
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <span>
+#include <vector>
+
+#include "BinaryTree.h"
+#include "LockFreeTree.h"
+#include "OptimisticTree.h"
+#include "PersistentTree.h"
+#include "RcuTree.h"
+#include "TraceReplay.h"
+
+using Key = std::int64_t;
+using Trace = std::vector<tracefile::Op<Key>>;
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::fprintf(stderr, "failed: %s\n", what);
+		++failures;
+	}
+}
+
+// Keys below keySpace; with unique set, an insert only ever adds a new key.
+Trace mixedTrace(std::uint32_t seed, Key keySpace, bool unique)
+{
+	Trace trace;
+	std::set<Key> present;
+	std::mt19937 rng(seed);
+	for (int i = 0; i < 20000; ++i)
+	{
+		Key key = Key(rng() % std::uint32_t(keySpace));
+		switch (rng() % 8)
+		{
+		case 0: case 1: case 2:
+			if (unique && !present.insert(key).second)
+				trace.push_back({ tracefile::OpKind::Search, key, 0 });
+			else
+				trace.push_back({ tracefile::OpKind::Insert, key, 0 });
+			break;
+		case 3: case 4:
+			trace.push_back({ tracefile::OpKind::Search, key, 0 });
+			break;
+		case 5:
+			present.erase(key);
+			trace.push_back({ tracefile::OpKind::Erase, key, 0 });
+			break;
+		default:
+			trace.push_back({ tracefile::OpKind::Range, key, key + Key(rng() % 64) });
+			break;
+		}
+	}
+	return trace;
+}
+
+template <class Engine>
+tracereplay::Report run(const Trace& trace)
+{
+	Engine engine;
+	return tracereplay::replay(engine, std::span<const tracefile::Op<Key>>(trace));
+}
+
+// Total values visited by the trace's ranges in an engine with the
+// semantics of Model.
+template <class Model>
+std::size_t rangeHits(const Trace& trace)
+{
+	Model model;
+	std::size_t hits = 0;
+	for (const tracefile::Op<Key>& op : trace)
+	{
+		if (op.kind == tracefile::OpKind::Insert)
+			model.insert(op.key);
+		else if (op.kind == tracefile::OpKind::Erase && model.count(op.key) != 0)
+			model.erase(model.find(op.key));
+		else if (op.kind == tracefile::OpKind::Range)
+			for (auto it = model.lower_bound(op.key); it != model.end() && !(op.high < *it); ++it)
+				++hits;
+	}
+	return hits;
+}
+
+int main()
+{
+	std::size_t range = tracefile::kindIndex(tracefile::OpKind::Range);
+	for (std::uint32_t seed = 1; seed <= 4; ++seed)
+	{
+		Trace trace = mixedTrace(seed, 1000, false);
+		tracereplay::Report binary = run<BinaryTree<Key>>(trace);
+		tracereplay::Report persistent = run<PersistentTree<Key>>(trace);
+		tracereplay::Report rcu = run<RcuTree<Key>>(trace);
+		tracereplay::Report optimistic = run<OptimisticTree<Key>>(trace);
+		tracereplay::Report lockfree = run<LockFreeTree<Key>>(trace);
+		for (const tracereplay::Report* report : { &binary, &persistent, &rcu, &optimistic, &lockfree })
+			check(report->unsupported[range] == 0, "every engine replays ranges");
+		check(binary.digest == persistent.digest && binary.digest == rcu.digest && binary.digest == optimistic.digest,
+			"multisets agree on the digest");
+		check(binary.hits[range] == rangeHits<std::multiset<Key>>(trace), "multiset range hits match std::multiset");
+		check(lockfree.hits[range] == rangeHits<std::set<Key>>(trace), "set range hits match std::set");
+
+		Trace unique = mixedTrace(seed, 1000, true);
+		std::uint64_t digest = run<BinaryTree<Key>>(unique).digest;
+		check(run<PersistentTree<Key>>(unique).digest == digest && run<RcuTree<Key>>(unique).digest == digest
+			&& run<OptimisticTree<Key>>(unique).digest == digest && run<LockFreeTree<Key>>(unique).digest == digest,
+			"all engines agree without duplicate inserts");
+	}
+
+	if (failures == 0)
+		std::printf("all checks passed\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}